@@ -1,21 +1,970 @@
 #include "bigint.h"
+#include "poly.h"
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/* low-level limb routines
+ * mpn-style kernels working on raw little-endian limb arrays, the layout of
+ * bigint::value. Output arrays never alias the inputs unless stated otherwise.
+ */
+namespace {
+using uint64 = std::uint64_t;
+using uint128 = unsigned __int128;
+constexpr unsigned b_exp = 64;
+
+/* Kernel scratch buffer of n limbs, taken from a thread local stack and
+ * given back when it goes out of scope. Buffers are freed in reverse order
+ * of creation, so once the stack has grown to its high-water mark the
+ * recursive kernels no longer call malloc. The contents are uninitialized.
+ */
+class scratch {
+    public:
+        explicit scratch(std::size_t n) : start(stack().mark()), p(stack().allocate(n)), len(n) {}
+        ~scratch() {
+            stack().rewind(start);
+        }
+        scratch(const scratch&) = delete;
+        scratch& operator=(const scratch&) = delete;
+
+        uint64* data() noexcept { return p; }
+        std::size_t size() const noexcept { return len; }
+        uint64* begin() noexcept { return p; }
+        uint64* end() noexcept { return p + len; }
+        uint64& operator[](std::size_t i) noexcept { return p[i]; }
+
+    private:
+        static bigint::arena& stack() {
+            thread_local bigint::arena s;
+            return s;
+        }
+
+        bigint::arena::position start;
+        uint64* p;
+        std::size_t len;
+};
+
+/* Work-stealing thread pool for the multiplication kernels
+ * Every worker owns a deque of tasks, it takes work from the back of its own
+ * and steals from the front of the others'. Threads outside the pool submit
+ * to a shared queue. Workers are started on demand and only the first
+ * bigint::threads - 1 of them, as of the latest fork, take tasks.
+ */
+struct task {
+    std::function<void()> fn;
+    std::exception_ptr error{};
+    std::atomic<bool> done{false};
+};
+
+// 0 outside the pool, i + 1 on worker i
+thread_local std::size_t worker_id = 0;
+
+class thread_pool {
+    public:
+        static constexpr std::size_t max_workers = 255;
+
+        static thread_pool& get() {
+            static thread_pool pool;
+            return pool;
+        }
+
+        ~thread_pool() {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stop = true;
+            }
+            wake.notify_all();
+            for (std::thread& w: workers) {
+                w.join();
+            }
+        }
+
+        // starts workers until there are n, further ones stay idle
+        void reserve(std::size_t n) {
+            n = std::min(n, max_workers);
+            active = n;
+            std::lock_guard<std::mutex> lock(m);
+            while (workers.size() < n) {
+                workers.emplace_back(&thread_pool::work, this, workers.size());
+            }
+        }
+
+        void push(task* t) {
+            queue& q = queues[worker_id];
+            {
+                std::lock_guard<std::mutex> lock(q.m);
+                q.tasks.push_back(t);
+            }
+            ++pending;
+            // taking the lock orders this against a worker going to sleep
+            { std::lock_guard<std::mutex> lock(m); }
+            wake.notify_all();
+        }
+
+        // runs one pending task, returns false if there was none
+        bool run_one() {
+            task* t = take(worker_id);
+            if (!t) {
+                return false;
+            }
+            try {
+                t->fn();
+            }
+            catch (...) {
+                t->error = std::current_exception();
+            }
+            t->done.store(true, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        struct queue {
+            std::mutex m;
+            std::deque<task*> tasks;
+        };
+
+        thread_pool() : queues(new queue[max_workers + 1]) {}
+
+        task* take(std::size_t self) {
+            if (pending.load(std::memory_order_acquire) == 0) {
+                return nullptr;
+            }
+            // own tasks newest first, then the oldest task of anyone else
+            for (std::size_t i = 0; i <= max_workers; ++i) {
+                const std::size_t id = (self + i) % (max_workers + 1);
+                queue& q = queues[id];
+                std::lock_guard<std::mutex> lock(q.m);
+                if (!q.tasks.empty()) {
+                    task* t;
+                    if (i == 0) {
+                        t = q.tasks.back();
+                        q.tasks.pop_back();
+                    }
+                    else {
+                        t = q.tasks.front();
+                        q.tasks.pop_front();
+                    }
+                    --pending;
+                    return t;
+                }
+            }
+            return nullptr;
+        }
+
+        void work(std::size_t id) {
+            worker_id = id + 1;
+            while (true) {
+                if (id < active && run_one()) {
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(m);
+                if (stop) {
+                    return;
+                }
+                if (pending == 0 || id >= active) {
+                    wake.wait(lock);
+                }
+            }
+        }
+
+        std::unique_ptr<queue[]> queues; // [0] is shared, [i + 1] belongs to worker i
+        std::vector<std::thread> workers{};
+        std::atomic<std::size_t> pending{0};
+        std::atomic<std::size_t> active{0};
+        std::mutex m;
+        std::condition_variable wake;
+        bool stop = false;
+};
+
+// whether work on operands of the given length is split between threads
+bool parallel(std::size_t size) {
+    return bigint::threads > 1 && size >= bigint::parallel_cutoff;
+}
+
+/* Runs f(0) .. f(count - 1) concurrently and returns when all are done, or
+ * one after another if parallel(size) is false. A waiting thread executes
+ * pending tasks in the meantime, so recursive splitting never leaves a
+ * thread blocked.
+ */
+template <class F>
+void fork_each(std::size_t size, std::size_t count, F f) {
+    if (!parallel(size)) {
+        for (std::size_t i = 0; i < count; ++i) {
+            f(i);
+        }
+        return;
+    }
+    thread_pool& pool = thread_pool::get();
+    pool.reserve(bigint::threads - 1);
+    std::deque<task> tasks;
+    for (std::size_t i = 0; i < count; ++i) {
+        tasks.emplace_back().fn = [&f, i] { f(i); };
+        pool.push(&tasks.back());
+    }
+    for (task& t: tasks) {
+        while (!t.done.load(std::memory_order_acquire)) {
+            if (!pool.run_one()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    for (task& t: tasks) {
+        if (t.error) {
+            std::rethrow_exception(t.error);
+        }
+    }
+}
+
+// runs the calls f... as fork_each does
+template <class... F>
+void fork(std::size_t size, F&&... f) {
+    if (!parallel(size)) {
+        (f(), ...);
+        return;
+    }
+    std::function<void()> calls[] = {std::function<void()>(std::forward<F>(f))...};
+    fork_each(size, sizeof...(F), [&calls](std::size_t i) { calls[i](); });
+}
+
+// r = a + b, returns the carry, r may alias a or b
+uint64 add_n(uint64* r, const uint64* a, const uint64* b, std::size_t n) {
+#if defined(__x86_64__)
+    unsigned char carry = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned long long sum;
+        carry = _addcarry_u64(carry, a[i], b[i], &sum);
+        r[i] = sum;
+    }
+    return carry;
+#else
+    uint64 carry = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        uint64 sum = a[i] + carry;
+        carry = sum < carry;
+        sum += b[i];
+        carry += sum < b[i];
+        r[i] = sum;
+    }
+    return carry;
+#endif
+}
+
+// r = a - b, returns the borrow, r may alias a or b
+uint64 sub_n(uint64* r, const uint64* a, const uint64* b, std::size_t n) {
+#if defined(__x86_64__)
+    unsigned char borrow = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned long long diff;
+        borrow = _subborrow_u64(borrow, a[i], b[i], &diff);
+        r[i] = diff;
+    }
+    return borrow;
+#else
+    uint64 borrow = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        uint64 diff = a[i] - b[i];
+        uint64 b1 = a[i] < b[i];
+        b1 += diff < borrow;
+        r[i] = diff - borrow;
+        borrow = b1;
+    }
+    return borrow;
+#endif
+}
+
+// r = a + b, an >= bn, returns the carry, r may alias a
+uint64 add(uint64* r, const uint64* a, std::size_t an, const uint64* b, std::size_t bn) {
+    uint64 carry = add_n(r, a, b, bn);
+    for (std::size_t i = bn; i < an; ++i) {
+        r[i] = a[i] + carry;
+        carry = r[i] < carry;
+    }
+    return carry;
+}
+
+// r -= a, an <= rn, returns the borrow
+uint64 sub_in(uint64* r, std::size_t rn, const uint64* a, std::size_t an) {
+    uint64 borrow = sub_n(r, r, a, an);
+    for (std::size_t i = an; borrow && i < rn; ++i) {
+        borrow = r[i] == 0;
+        --r[i];
+    }
+    return borrow;
+}
+
+// r = -r modulo base^n, two's complement negation
+void neg_in(uint64* r, std::size_t n) {
+    std::size_t i = 0;
+    while (i < n && r[i] == 0) {
+        ++i;
+    }
+    if (i < n) {
+        r[i] = 0 - r[i];
+        for (++i; i < n; ++i) {
+            r[i] = ~r[i];
+        }
+    }
+}
+
+// r += a, carry is propagated up to r[rn - 1] and dropped after that
+void add_in(uint64* r, std::size_t rn, const uint64* a, std::size_t an) {
+    an = std::min(an, rn);
+    uint64 carry = add_n(r, r, a, an);
+    for (std::size_t i = an; carry && i < rn; ++i) {
+        carry = ++r[i] == 0;
+    }
+}
+
+// r = a * b + c, returns the carry, r may alias a
+uint64 mul_1(uint64* r, const uint64* a, std::size_t n, uint64 b, uint64 c = 0) {
+    for (std::size_t i = 0; i < n; ++i) {
+        uint128 p = static_cast<uint128>(a[i]) * b + c;
+        r[i] = static_cast<uint64>(p);
+        c = p >> b_exp;
+    }
+    return c;
+}
+
+#if defined(__x86_64__)
+// mulx, adcx and adox are available, checked once at startup
+const bool cpu_adx = __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+#endif
+
+// r[0..n) += a[0..n) * b, returns the carry
+uint64 addmul_1(uint64* r, const uint64* a, std::size_t n, uint64 b) {
+    uint64 carry = 0;
+    std::size_t head = n;
+#if defined(__x86_64__)
+    if (cpu_adx) {
+        head = n & 3;
+    }
+#endif
+    for (std::size_t i = 0; i < head; ++i) {
+        uint128 p = static_cast<uint128>(a[i]) * b + r[i] + carry; // < 2^128
+        r[i] = static_cast<uint64>(p);
+        carry = p >> b_exp;
+    }
+#if defined(__x86_64__)
+    if (head < n) {
+        // four limbs per round with two independent carry chains: adcx adds
+        // the high half of the previous product, adox the limb of r
+        uint64 lo, hi, zero;
+        std::int64_t i = -static_cast<std::int64_t>(n - head);
+        __asm__ volatile(
+            "xorl %k[zero], %k[zero]\n\t"
+            "1:\n\t"
+            "mulx (%[a],%[i],8), %[lo], %[hi]\n\t"
+            "adcx %[c], %[lo]\n\t"
+            "adox (%[r],%[i],8), %[lo]\n\t"
+            "movq %[lo], (%[r],%[i],8)\n\t"
+            "mulx 8(%[a],%[i],8), %[lo], %[c]\n\t"
+            "adcx %[hi], %[lo]\n\t"
+            "adox 8(%[r],%[i],8), %[lo]\n\t"
+            "movq %[lo], 8(%[r],%[i],8)\n\t"
+            "mulx 16(%[a],%[i],8), %[lo], %[hi]\n\t"
+            "adcx %[c], %[lo]\n\t"
+            "adox 16(%[r],%[i],8), %[lo]\n\t"
+            "movq %[lo], 16(%[r],%[i],8)\n\t"
+            "mulx 24(%[a],%[i],8), %[lo], %[c]\n\t"
+            "adcx %[hi], %[lo]\n\t"
+            "adox 24(%[r],%[i],8), %[lo]\n\t"
+            "movq %[lo], 24(%[r],%[i],8)\n\t"
+            // lea and jrcxz leave both carry chains alone
+            "leaq 4(%[i]), %[i]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            "adcx %[zero], %[c]\n\t"
+            "adox %[zero], %[c]\n\t"
+            : [c] "+&r"(carry), [lo] "=&r"(lo), [hi] "=&r"(hi), [zero] "=&r"(zero), [i] "+c"(i)
+            : [a] "r"(a + n), [r] "r"(r + n), "d"(b)
+            : "cc", "memory");
+    }
+#endif
+    return carry;
+}
+
+// r[0..n) -= a[0..n) * b, returns the borrow
+uint64 submul_1(uint64* r, const uint64* a, std::size_t n, uint64 b) {
+    uint64 carry = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        uint128 p = static_cast<uint128>(a[i]) * b + carry;
+        uint64 lo = static_cast<uint64>(p);
+        carry = p >> b_exp;
+        carry += r[i] < lo;
+        r[i] -= lo;
+    }
+    return carry;
+}
+
+// r = a << s, s < b_exp, returns the bits shifted out, r may alias a
+uint64 lshift(uint64* r, const uint64* a, std::size_t n, unsigned s) {
+    if (s == 0) {
+        std::copy_backward(a, a + n, r + n);
+        return 0;
+    }
+    uint64 out = a[n-1] >> (b_exp - s);
+    for (std::size_t i = n - 1; i > 0; --i) {
+        r[i] = a[i] << s | a[i-1] >> (b_exp - s);
+    }
+    r[0] = a[0] << s;
+    return out;
+}
+
+// r = a >> s, s < b_exp, r may alias a
+void rshift(uint64* r, const uint64* a, std::size_t n, unsigned s) {
+    if (s == 0) {
+        std::copy(a, a + n, r);
+        return;
+    }
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        r[i] = a[i] >> s | a[i+1] << (b_exp - s);
+    }
+    r[n-1] = a[n-1] >> s;
+}
+
+// r /= 3 by Hensel's exact division, r has to be divisible by 3
+void divexact_by3(uint64* r, std::size_t n) {
+    constexpr uint64 inv3 = 0xaaaaaaaaaaaaaaabULL; // 3 * inv3 == 1 mod 2^64
+    uint64 c = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        uint64 b = r[i] < c;
+        uint64 q = (r[i] - c) * inv3;
+        r[i] = q;
+        c = static_cast<uint64>(static_cast<uint128>(q) * 3 >> b_exp) + b;
+    }
+}
+
+// compares a and b, both n limbs long
+int cmp_n(const uint64* a, const uint64* b, std::size_t n) {
+    for (std::size_t i = n; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+// r = |a - b|, returns true if a < b
+bool abs_diff_n(uint64* r, const uint64* a, const uint64* b, std::size_t n) {
+    if (cmp_n(a, b, n) < 0) {
+        sub_n(r, b, a, n);
+        return true;
+    }
+    sub_n(r, a, b, n);
+    return false;
+}
+
+// (hi*2^64 + lo) / d, hi < d, rem = remainder
+inline uint64 udiv_qr(uint64 hi, uint64 lo, uint64 d, uint64& rem) {
+#if defined(__x86_64__)
+    uint64 q;
+    __asm__("divq %4" : "=a"(q), "=d"(rem) : "a"(lo), "d"(hi), "rm"(d));
+    return q;
+#else
+    uint128 num = static_cast<uint128>(hi) << b_exp | lo;
+    rem = static_cast<uint64>(num % d);
+    return static_cast<uint64>(num / d);
+#endif
+}
+
+void mul(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m);
+void sqr(uint64* r, const uint64* a, std::size_t n);
+
+// schoolbook O(n*m), r = a * b
+void mul_basecase(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m) {
+    r[n] = mul_1(r, a, n, b[0]);
+    for (std::size_t i = 1; i < m; ++i) {
+        r[i+n] = addmul_1(r + i, a, n, b[i]);
+    }
+}
+
+// schoolbook squaring, every cross product a_i * a_j is computed only once
+void sqr_basecase(uint64* r, const uint64* a, std::size_t n) {
+    std::fill(r, r + 2 * n, 0);
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        r[i + n] = addmul_1(r + 2*i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+    lshift(r, r, 2 * n, 1);
+    uint64 carry = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        uint128 sq = static_cast<uint128>(a[i]) * a[i];
+        uint128 lo = static_cast<uint128>(r[2*i]) + static_cast<uint64>(sq) + carry;
+        uint128 hi = static_cast<uint128>(r[2*i + 1]) + static_cast<uint64>(sq >> b_exp) + (lo >> b_exp);
+        r[2*i] = static_cast<uint64>(lo);
+        r[2*i + 1] = static_cast<uint64>(hi);
+        carry = hi >> b_exp;
+    }
+}
+
+/* Karatsuba, n >= m > ceil(n/2)
+ * a*b = z2*B^2k + ((a0 + a1)(b0 + b1) - z0 - z2)*B^k + z0
+ */
+void mul_karatsuba(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m) {
+    const bool square = a == b && n == m;
+    const std::size_t k = (n + 1) / 2;
+    scratch sa(k + 1), sb(k + 1), z1(2 * k + 2);
+
+    sa[k] = add(sa.data(), a, k, a + k, n - k);
+    if (square) {
+        fork(k, [&] { sqr(r, a, k); },
+                [&] { sqr(r + 2 * k, a + k, n - k); },
+                [&] { sqr(z1.data(), sa.data(), k + 1); });
+    }
+    else {
+        sb[k] = add(sb.data(), b, k, b + k, m - k);
+        fork(k, [&] { mul(r, a, k, b, k); },
+                [&] { mul(r + 2 * k, a + k, n - k, b + k, m - k); },
+                [&] { mul(z1.data(), sa.data(), k + 1, sb.data(), k + 1); });
+    }
+    sub_in(z1.data(), z1.size(), r, 2 * k);
+    sub_in(z1.data(), z1.size(), r + 2 * k, n + m - 2 * k);
+    add_in(r + k, n + m - k, z1.data(), z1.size());
+}
+
+/* Toom-Cook 3-way, n >= m > 2*ceil(n/3)
+ * Evaluates at 0, 1, -1, 2 and infinity; interpolation sequence by Bodrato,
+ * every intermediate value is non-negative apart from v(-1).
+ */
+void mul_toom3(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m) {
+    const bool square = a == b && n == m;
+    const std::size_t k = (n + 2) / 3;
+    const std::size_t l = 2 * k + 2;
+    const uint64* a0 = a;
+    const uint64* a1 = a + k;
+    const uint64* a2 = a + 2 * k;
+    const uint64* b0 = b;
+    const uint64* b1 = b + k;
+    const uint64* b2 = b + 2 * k;
+
+    // p(x) = a0 + a1*x + a2*x^2 evaluated at 1, -1 and 2
+    scratch p1(k + 1), pm1(k + 1), p2(k + 1);
+    scratch q1(k + 1), qm1(k + 1), q2(k + 1);
+    auto eval = [k](const uint64* x0, const uint64* x1, const uint64* x2, std::size_t x2n,
+                    scratch& e1, scratch& em1, scratch& e2) {
+        scratch t(k + 1);
+        t[k] = add(t.data(), x0, k, x2, x2n);
+        e1[k] = t[k] + add_n(e1.data(), t.data(), x1, k);
+        scratch x1e(k + 1);
+        std::copy(x1, x1 + k, x1e.begin());
+        x1e[k] = 0;
+        bool neg = abs_diff_n(em1.data(), t.data(), x1e.data(), k + 1);
+        // e2 = ((2*x2 + x1) * 2) + x0
+        std::fill(e2.begin(), e2.end(), 0);
+        std::copy(x2, x2 + x2n, e2.begin());
+        lshift(e2.data(), e2.data(), k + 1, 1);
+        add_in(e2.data(), k + 1, x1, k);
+        lshift(e2.data(), e2.data(), k + 1, 1);
+        add_in(e2.data(), k + 1, x0, k);
+        return neg;
+    };
+    bool neg = eval(a0, a1, a2, n - 2 * k, p1, pm1, p2);
+    if (!square) {
+        neg ^= eval(b0, b1, b2, m - 2 * k, q1, qm1, q2);
+    }
+    else {
+        neg = false;
+    }
+
+    scratch v1(l), vm1(l), v2(l), vinf(l);
+    std::fill(vinf.begin(), vinf.end(), 0);
+    const std::size_t inf_n = n + m - 4 * k;
+    if (square) {
+        fork(k, [&] { sqr(r, a0, k); },
+                [&] { sqr(v1.data(), p1.data(), k + 1); },
+                [&] { sqr(vm1.data(), pm1.data(), k + 1); },
+                [&] { sqr(v2.data(), p2.data(), k + 1); },
+                [&] { sqr(vinf.data(), a2, n - 2 * k); });
+    }
+    else {
+        fork(k, [&] { mul(r, a0, k, b0, k); },
+                [&] { mul(v1.data(), p1.data(), k + 1, q1.data(), k + 1); },
+                [&] { mul(vm1.data(), pm1.data(), k + 1, qm1.data(), k + 1); },
+                [&] { mul(v2.data(), p2.data(), k + 1, q2.data(), k + 1); },
+                [&] { mul(vinf.data(), a2, n - 2 * k, b2, m - 2 * k); });
+    }
+
+    // interpolation, r(x) = c0 + c1*x + c2*x^2 + c3*x^3 + c4*x^4
+    // v2 = (v2 - vm1) / 3 = c1 + c2 + 3*c3 + 5*c4
+    if (neg) add_n(v2.data(), v2.data(), vm1.data(), l);
+    else sub_n(v2.data(), v2.data(), vm1.data(), l);
+    divexact_by3(v2.data(), l);
+    // vm1 = (v1 - vm1) / 2 = c1 + c3
+    if (neg) add_n(vm1.data(), v1.data(), vm1.data(), l);
+    else sub_n(vm1.data(), v1.data(), vm1.data(), l);
+    rshift(vm1.data(), vm1.data(), l, 1);
+    // v1 = v1 - v0 = c1 + c2 + c3 + c4
+    sub_in(v1.data(), l, r, 2 * k);
+    // v2 = (v2 - v1) / 2 = c3 + 2*c4
+    sub_n(v2.data(), v2.data(), v1.data(), l);
+    rshift(v2.data(), v2.data(), l, 1);
+    // v1 = v1 - vm1 = c2 + c4
+    sub_n(v1.data(), v1.data(), vm1.data(), l);
+    // v2 = v2 - 2*vinf = c3
+    sub_in(v2.data(), l, vinf.data(), inf_n);
+    sub_in(v2.data(), l, vinf.data(), inf_n);
+    // v1 = v1 - vinf = c2
+    sub_in(v1.data(), l, vinf.data(), inf_n);
+    // vm1 = vm1 - v2 = c1
+    sub_n(vm1.data(), vm1.data(), v2.data(), l);
+
+    std::fill(r + 2 * k, r + 4 * k, 0);
+    std::copy(vinf.begin(), vinf.begin() + inf_n, r + 4 * k);
+    add_in(r + k, n + m - k, vm1.data(), l);
+    add_in(r + 2 * k, n + m - 2 * k, v1.data(), l);
+    add_in(r + 3 * k, n + m - 3 * k, v2.data(), l);
+}
+
+// a * b modulo Mod, by poly.h's transforms
+template <i64 Mod>
+Poly<Mod> ntt_convolve(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+    const Poly<Mod> fa(a.begin(), a.end());
+    if (&a == &b) {
+        return poly_mul(fa, fa);
+    }
+    return poly_mul(fa, Poly<Mod>(b.begin(), b.end()));
+}
+
+// NTT-friendly primes c*2^k + 1
+constexpr i64 ntt_p1 = 754974721; // 45*2^24 + 1
+constexpr i64 ntt_p2 = 167772161; // 5*2^25 + 1
+constexpr i64 ntt_p3 = 469762049; // 7*2^26 + 1
+
+/* The transforms run on 32-bit halves of the limbs. The longest transform all
+ * three primes support is 2^24 halves, and as p1*p2*p3 > 2^85 while each
+ * coefficient is < min(n, m) * 2 * 2^64, the shorter operand is limited to
+ * 2^20 limbs.
+ */
+constexpr std::size_t ntt_max_len = std::size_t(1) << 24;
+constexpr std::size_t ntt_max_limbs = std::size_t(1) << 20;
+
+std::vector<std::uint32_t> split_halves(const uint64* a, std::size_t n) {
+    std::vector<std::uint32_t> h(2 * n);
+    for (std::size_t i = 0; i < n; ++i) {
+        h[2*i] = static_cast<std::uint32_t>(a[i]);
+        h[2*i + 1] = static_cast<std::uint32_t>(a[i] >> 32);
+    }
+    return h;
+}
+
+/* Three-prime NTT multiplication, r = a * b
+ * The product is computed modulo three primes and the coefficients are
+ * recovered with Garner's algorithm (CRT).
+ */
+void mul_ntt(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m) {
+    const bool square = a == b && n == m;
+    const std::vector<std::uint32_t> ha = split_halves(a, n);
+    const std::vector<std::uint32_t> hb = square ? std::vector<std::uint32_t>{} : split_halves(b, m);
+    const std::vector<std::uint32_t>& hb_ref = square ? ha : hb;
+    const std::size_t coeffs = 2 * (n + m) - 1;
+    Poly<ntt_p1> c1;
+    Poly<ntt_p2> c2;
+    Poly<ntt_p3> c3;
+    fork(m, [&] { c1 = ntt_convolve<ntt_p1>(ha, hb_ref); },
+            [&] { c2 = ntt_convolve<ntt_p2>(ha, hb_ref); },
+            [&] { c3 = ntt_convolve<ntt_p3>(ha, hb_ref); });
+
+    // x = r1 + p1*t1 + p1*p2*t2
+    const Field<ntt_p2> p1_inv = Field<ntt_p2>(1) / Field<ntt_p2>(ntt_p1);
+    const Field<ntt_p3> p1p2_inv = Field<ntt_p3>(1) / (Field<ntt_p3>(ntt_p1) * Field<ntt_p3>(ntt_p2));
+    constexpr uint128 p1p2 = static_cast<uint128>(ntt_p1) * ntt_p2;
+
+    uint128 carry = 0;
+    for (std::size_t i = 0; i < 2 * (n + m); ++i) {
+        if (i < coeffs) {
+            i64 r1 = c1[i].value();
+            Field<ntt_p2> t1 = (Field<ntt_p2>(c2[i].value()) - Field<ntt_p2>(r1)) * p1_inv;
+            Field<ntt_p3> t2 = (Field<ntt_p3>(c3[i].value()) - Field<ntt_p3>(r1)
+                               - Field<ntt_p3>(ntt_p1) * Field<ntt_p3>(t1.value())) * p1p2_inv;
+            carry += static_cast<uint128>(r1)
+                   + static_cast<uint128>(ntt_p1) * t1.value()
+                   + p1p2 * t2.value();
+        }
+        const uint64 half = static_cast<std::uint32_t>(carry);
+        if (i & 1) {
+            r[i/2] |= half << 32;
+        }
+        else {
+            r[i/2] = half;
+        }
+        carry >>= 32;
+    }
+}
+
+// Karatsuba recurses on k + 1 limb halves, which only shrinks from 4 limbs up
+constexpr std::size_t min_cutoff = 4;
+
+// r = a * b, n >= m, r[0..n+m)
+void mul(uint64* r, const uint64* a, std::size_t n, const uint64* b, std::size_t m) {
+    if (a == b && n == m) {
+        sqr(r, a, n);
+    }
+    else if (m < std::max(bigint::karatsuba_cutoff, min_cutoff)) {
+        mul_basecase(r, a, n, b, m);
+    }
+    else if (m >= bigint::ntt_cutoff && m <= ntt_max_limbs && 2 * (n + m) <= ntt_max_len) {
+        mul_ntt(r, a, n, b, m);
+    }
+    else if (n + 1 >= 2 * m) {
+        // unbalanced, multiply b by m-limb blocks of a
+        std::fill(r, r + n + m, 0);
+        const std::size_t blocks = (n + m - 1) / m;
+        if (parallel(m)) {
+            // even blocks go straight to r and odd ones to t, neither
+            // overlaps; the carries are merged when adding t at the end
+            scratch t(n + m);
+            std::fill(t.begin(), t.end(), 0);
+            fork_each(m, blocks, [&](std::size_t j) {
+                const std::size_t i = j * m;
+                const std::size_t len = std::min(m, n - i);
+                uint64* p = (j & 1 ? t.data() : r) + i;
+                if (len >= m) mul(p, a + i, len, b, m);
+                else mul(p, b, m, a + i, len);
+            });
+            add_in(r, n + m, t.data(), n + m);
+            return;
+        }
+        scratch t(2 * m);
+        for (std::size_t i = 0; i < n; i += m) {
+            std::size_t len = std::min(m, n - i);
+            if (len >= m) mul(t.data(), a + i, len, b, m);
+            else mul(t.data(), b, m, a + i, len);
+            add_in(r + i, n + m - i, t.data(), len + m);
+        }
+    }
+    else if (m >= bigint::toom3_cutoff && m > 2 * ((n + 2) / 3)) {
+        mul_toom3(r, a, n, b, m);
+    }
+    else {
+        mul_karatsuba(r, a, n, b, m);
+    }
+}
+
+// r = a * a, r[0..2n)
+void sqr(uint64* r, const uint64* a, std::size_t n) {
+    if (n < std::max(bigint::karatsuba_sqr_cutoff, min_cutoff)) {
+        sqr_basecase(r, a, n);
+    }
+    else if (n < bigint::toom3_sqr_cutoff || n <= 2 * ((n + 2) / 3)) {
+        mul_karatsuba(r, a, n, a, n);
+    }
+    else if (n >= bigint::ntt_cutoff && n <= ntt_max_limbs) {
+        mul_ntt(r, a, n, a, n);
+    }
+    else {
+        mul_toom3(r, a, n, a, n);
+    }
+}
+
+/* division kernels */
+// q = a / d for a single limb d, returns the remainder, q may alias a
+uint64 divrem_1(uint64* q, const uint64* a, std::size_t n, uint64 d) {
+    uint64 rem = 0;
+    for (std::size_t i = n; i-- > 0;) {
+        q[i] = udiv_qr(rem, a[i], d, rem);
+    }
+    return rem;
+}
+
+/* Knuth's algorithm D, TAOCP vol. 2, 4.3.1
+ * q[0..n-m] = a / d, r[0..m) = a % d; n >= m >= 2, d[m-1] != 0
+ */
+void divrem_knuth(uint64* q, uint64* r, const uint64* a, std::size_t n,
+                  const uint64* d, std::size_t m) {
+    // normalize so that the top limb of the divisor has its highest bit set
+    const unsigned s = __builtin_clzll(d[m-1]);
+    scratch dn(m), an(n + 1);
+    lshift(dn.data(), d, m, s);
+    an[n] = lshift(an.data(), a, n, s);
+
+    for (std::size_t j = n - m + 1; j-- > 0;) {
+        // estimate the quotient limb from the top two limbs, off by at most 2
+        uint64 qhat;
+        uint64 rhat;
+        bool rhat_overflow = false;
+        if (an[j+m] >= dn[m-1]) {
+            // an[j+m] == dn[m-1], the estimate would not fit in a limb
+            qhat = ~uint64(0);
+            rhat = an[j+m-1] + dn[m-1];
+            rhat_overflow = rhat < dn[m-1];
+        }
+        else {
+            qhat = udiv_qr(an[j+m], an[j+m-1], dn[m-1], rhat);
+        }
+        while (!rhat_overflow &&
+               static_cast<uint128>(qhat) * dn[m-2] > (static_cast<uint128>(rhat) << b_exp | an[j+m-2])) {
+            --qhat;
+            rhat += dn[m-1];
+            rhat_overflow = rhat < dn[m-1];
+        }
+
+        // an[j..j+m] -= qhat * dn, qhat was one too large if that went negative
+        uint64 borrow = submul_1(an.data() + j, dn.data(), m, qhat);
+        uint64 top = an[j+m];
+        an[j+m] = top - borrow;
+        if (top < borrow) {
+            --qhat;
+            an[j+m] += add_n(an.data() + j, an.data() + j, dn.data(), m);
+        }
+        q[j] = qhat;
+    }
+    rshift(r, an.data(), m, s);
+}
+
+/* Montgomery kernels
+ * n is odd with k limbs, ninv = -n^-1 mod base and R = base^k. Operands are
+ * below n, t is scratch of 2k + 1 limbs and r may alias the operands.
+ */
+// r = (top*base^k + t) mod n for a value below 2n; with ct the same
+// instructions run whether n is subtracted or not
+void mont_final(uint64* r, const uint64* t, uint64 top, const uint64* n, std::size_t k, bool ct) {
+    if (!ct) {
+        if (top || cmp_n(t, n, k) >= 0) {
+            sub_n(r, t, n, k);
+        }
+        else {
+            std::copy(t, t + k, r);
+        }
+        return;
+    }
+    const uint64 borrow = sub_n(r, t, n, k);
+    // keep t - n unless it went negative
+    const uint64 mask = 0 - (top | (borrow ^ 1));
+    for (std::size_t i = 0; i < k; ++i) {
+        r[i] = (r[i] & mask) | (t[i] & ~mask);
+    }
+}
+
+// r = t/R mod n for t < n*R held in t[0..2k), t[2k] == 0; destroys t
+void mont_redc(uint64* r, uint64* t, const uint64* n, std::size_t k, uint64 ninv) {
+    for (std::size_t i = 0; i < k; ++i) {
+        uint64 c = addmul_1(t + i, n, k, t[i] * ninv);
+        add_in(t + i + k, k + 1 - i, &c, 1);
+    }
+    mont_final(r, t + k, t[2 * k], n, k, false);
+}
+
+// r = a*b/R mod n, coarsely integrated operand scanning; the reduction of
+// each row is interleaved with its product and nothing branches on the data
+void mont_cios(uint64* r, const uint64* a, const uint64* b, uint64* t,
+               const uint64* n, std::size_t k, uint64 ninv, bool ct) {
+    std::fill(t, t + 2 * k + 1, 0);
+    for (std::size_t i = 0; i < k; ++i) {
+        uint64 c = addmul_1(t + i, a, k, b[i]);
+        const uint64 s = t[i+k] + c;
+        const uint64 c1 = s < c;
+        // t[i] becomes zero
+        c = addmul_1(t + i, n, k, t[i] * ninv);
+        t[i+k] = s + c;
+        t[i+k+1] = c1 + (t[i+k] < c);
+    }
+    mont_final(r, t + k, t[2 * k], n, k, ct);
+}
+} // namespace
+
+/* tunable multiplication cutoffs, operand lengths in limbs */
+std::size_t bigint::karatsuba_cutoff = 32;
+std::size_t bigint::toom3_cutoff = 160;
+std::size_t bigint::karatsuba_sqr_cutoff = 48;
+std::size_t bigint::toom3_sqr_cutoff = 192;
+std::size_t bigint::ntt_cutoff = 12288;
+
+/* divisor length in limbs from which division is done recursively */
+std::size_t bigint::bz_cutoff = 96;
+
+/* parallel multiplication, off by default */
+unsigned bigint::threads = 1;
+std::size_t bigint::parallel_cutoff = 1024;
+
+/* limb storage */
+bigint::arena::arena(std::size_t chunk_limbs) : chunk_limbs(std::max<std::size_t>(chunk_limbs, 1)) {}
+
+bigint::arena::~arena() {
+    for (chunk& c: chunks) {
+        delete[] c.data;
+    }
+}
+
+std::uint64_t* bigint::arena::allocate(std::size_t n) {
+    if (top.chunk < chunks.size() && chunks[top.chunk].size - top.offset >= n) {
+        std::uint64_t* p = chunks[top.chunk].data + top.offset;
+        top.offset += n;
+        return p;
+    }
+
+    // continue in the next chunk, chunks past the top hold nothing live
+    const std::size_t next = top.chunk + (top.offset > 0);
+    const std::size_t size = std::max(n, chunk_limbs << std::min<std::size_t>(next, 10));
+    if (next == chunks.size()) {
+        chunks.push_back({new std::uint64_t[size], size});
+    }
+    else if (chunks[next].size < n) {
+        delete[] chunks[next].data;
+        chunks[next] = {new std::uint64_t[size], size};
+    }
+    top = {next, n};
+    return chunks[next].data;
+}
+
+bigint::arena_scope::arena_scope(arena& a) noexcept : prev(active_arena) {
+    active_arena = &a;
+}
+
+bigint::arena_scope::~arena_scope() {
+    active_arena = prev;
+}
+
+// suspends the arena of this thread, for values that outlive it
+class bigint::heap_scope {
+    public:
+        heap_scope() noexcept : prev(active_arena) {
+            active_arena = nullptr;
+        }
+        ~heap_scope() {
+            active_arena = prev;
+        }
+
+    private:
+        arena* prev;
+};
+
+void bigint::limb_vector::grow(std::size_t n) {
+    if (n > UINT32_MAX) {
+        throw std::length_error("bigint too large");
+    }
+    n = std::min<std::size_t>(std::max<std::size_t>(n, 2 * std::size_t(cap)), UINT32_MAX);
+    // outside the scope of its arena a vector moves to the heap for good
+    arena* a = pool && pool == active_arena ? pool : nullptr;
+    uint64* p = a ? a->allocate(n) : new uint64[n];
+    std::copy(begin(), end(), p);
+    release();
+    heap = p;
+    cap = n;
+    pool = a;
+}
 
 /* constructors */
 // default constructor
-bigint::bigint(int n) {
-    // -n when -min_value
-    sign = n >= 0 ? POSITIVE : NEGATIVE;
-    n = sign == POSITIVE ? n : -n;
-    convert(n);
-}
+bigint::bigint(int n) : bigint(static_cast<int64>(n)) {}
 
 bigint::bigint(int64 n) {
     sign = n >= 0 ? POSITIVE : NEGATIVE;
-    n = sign == POSITIVE ? n : -n;
-    convert(n);
+    // negated as unsigned, -n overflows for the minimum value
+    convert(sign == POSITIVE ? n : 0 - static_cast<uint64>(n));
 }
 
 bigint::bigint(uint64 n) {
@@ -29,7 +978,22 @@ bigint::bigint(const bigint& n) {
     value = n.value;
 }
 
+// move constructor, n is left empty and may only be assigned to
+bigint::bigint(bigint&& n) noexcept : sign(n.sign), value(std::move(n.value)) {}
+
 /* assignment */
+bigint& bigint::operator=(int n) {
+    return *this = static_cast<int64>(n);
+}
+
+// reuses the current storage
+bigint& bigint::operator=(int64 n) {
+    sign = n >= 0 ? POSITIVE : NEGATIVE;
+    value.clear();
+    convert(sign == POSITIVE ? n : 0 - static_cast<uint64>(n));
+    return *this;
+}
+
 // copy assignment
 bigint& bigint::operator=(const bigint& n) { // = default
     sign = n.sign;
@@ -38,71 +1002,50 @@ bigint& bigint::operator=(const bigint& n) { // = default
 }
 
 // move assignment
-bigint& bigint::operator=(bigint&& n) {
+bigint& bigint::operator=(bigint&& n) noexcept {
     sign = n.sign;
     value = std::move(n.value);
     return *this;
 }
 
 /* operators */
-bigint& bigint::operator+=(const bigint& n) { // = default
-    if (sign != n.sign) {
-        return *this -= -n;
-    
-    }
-    if (n.value.size() > value.size()) {
-        value.resize(n.value.size(), 0);
-    }
-
-    uint64 carry = 0;
-    for (int i = 0; i < value.size(); ++i) {
-        uint64 sum = value[i] + carry + (n.value.size() > i ? n.value[i] : 0);
-        carry = sum >> b_exp;   // faster than sum >= base;
-        value[i] = sum & mask;  // faster than if (carry) sum -= base;
-    
-    }
-    if (carry) {
-        value.emplace_back(1);
-    
-    }
-    return *this;
+bigint& bigint::operator+=(const bigint& n) {
+    return add_signed(n, n.sign);
 }
 
 bigint& bigint::operator-=(const bigint& n) {
-    if (sign != n.sign) {
-        return *this += -n; // a, b >= 0; -a - b = -(a+b), a - (-b) = a+b
-    }
+    return add_signed(n, n.sign == POSITIVE ? NEGATIVE : POSITIVE);
+}
 
-    // a, b >= 0, a >= b; a-b
-    int64 borrow = 0;
-    if (gt_abs(*this, n)) {
-        for (int i = 0; i < value.size(); ++i) {
-            int64 diff = value[i] - (borrow + (n.value.size() > i ? n.value[i] : 0));
-            borrow = diff < 0;
-            value[i] = diff & mask;         // faster than if (borrow) diff += base;
+// *this += n_sign * abs(n), in place; n may alias *this
+bigint& bigint::add_signed(const bigint& n, Sign n_sign) {
+    if (!n) {
+        return *this;
+    }
+    if (sign == n_sign) {
+        // a + b, -a - b = -(a+b)
+        if (n.value.size() > value.size()) {
+            value.resize(n.value.size(), 0);
         }
-
-        // abs(*this) > abs(n) guarantees that value.empty() == false
-        while (value.back() == 0) { 
-            value.pop_back();
+        uint64 carry = add(value.data(), value.data(), value.size(), n.value.data(), n.value.size());
+        if (carry) {
+            value.emplace_back(carry);
         }
         return *this;
     }
 
-    // a, b >= 0, b > a; a-b = -(b-a), -a - (-b) = b-a = -(-b - (-a))
-    else if (gt_abs(n, *this)) {
-        bigint temp(n);
-        temp -= *this;
-        return *this = -temp;
+    if (!gt_abs(n, *this)) {
+        // abs(*this) >= abs(n), the sign stays
+        sub_in(value.data(), value.size(), n.value.data(), n.value.size());
     }
-
-    // a == b
     else {
-        value.clear();
-        value.emplace_back(0);
-        sign = POSITIVE;
-        return *this;
+        // abs(n) > abs(*this), *this = n_sign * (abs(n) - abs(*this))
+        value.resize(n.value.size(), 0);
+        sub_n(value.data(), n.value.data(), value.data(), value.size());
+        sign = n_sign;
     }
+    trim();
+    return *this;
 }
 
 bigint& bigint::operator*=(const bigint& n) {
@@ -110,18 +1053,28 @@ bigint& bigint::operator*=(const bigint& n) {
         return *this = bigint(0);
     }
 
+    // single limb multiplier, in place
+    if (n.value.size() == 1 && this != &n) {
+        uint64 carry = mul_1(value.data(), value.data(), value.size(), n.value[0], 0);
+        if (carry) {
+            value.emplace_back(carry);
+        }
+        sign = static_cast<Sign>(sign * n.sign);
+        return *this;
+    }
+
     bigint p(0);
-    p.value.resize(value.size() + n.value.size(), 0); // avoids for (...) if (...) 
+    p.value.resize(value.size() + n.value.size(), 0);
     p.sign = static_cast<Sign>(sign * n.sign);
 
-    for (int i = 0; i < n.value.size(); ++i) {
-        uint64 carry = 0;
-        for (int j = 0; j < value.size(); ++j) {
-            uint64 new_val = carry + p.value[i+j] + value[j] * n.value[i];
-            p.value[i+j] = new_val & mask; // new_val % base
-            carry = new_val >> b_exp; // new_val / base
-        }
-        p.value[i+value.size()] = carry;
+    if (this == &n) {
+        sqr(p.value.data(), value.data(), value.size());
+    }
+    else if (value.size() >= n.value.size()) {
+        mul(p.value.data(), value.data(), value.size(), n.value.data(), n.value.size());
+    }
+    else {
+        mul(p.value.data(), n.value.data(), n.value.size(), value.data(), value.size());
     }
 
     while (p.value.size() > 1 && p.value.back() == 0) {
@@ -131,8 +1084,13 @@ bigint& bigint::operator*=(const bigint& n) {
     return *this = std::move(p);
 }
 
-// TODO
 bigint& bigint::operator/=(const bigint& n) {
+    assert(!!n);
+    const Sign s = static_cast<Sign>(sign * n.sign);
+    bigint r;
+    divmod_abs(*this, n, *this, r);
+    sign = s;
+    trim();
     return *this;
 }
 
@@ -152,40 +1110,303 @@ bigint& bigint::operator--(int n) {
     return *this -= 1;
 }
 
-// TODO
+// the remainder takes the sign of the dividend, cf. built-in integers
 bigint& bigint::operator%=(const bigint& n) {
+    assert(!!n);
+    const Sign s = sign;
+    bigint q;
+    divmod_abs(*this, n, q, *this);
+    sign = s;
+    trim();
     return *this;
 }
 
-bigint bigint::operator+(const bigint& n) const {
-    return bigint(*this) += n;
+// a temporary dividend is reused for the quotient
+bigint operator/(bigint a, const bigint& b) {
+    a /= b;
+    return a;
 }
 
-bigint bigint::operator-(const bigint& n) const {
-    return bigint(*this) -= n;
+bigint operator%(bigint a, const bigint& b) {
+    a %= b;
+    return a;
 }
 
-bigint bigint::operator*(const bigint& n) const {
-    return bigint(*this) *= n;
+bigint& bigint::addmul(const bigint& a, const bigint& b) {
+    return *this += a * b;
 }
 
-bigint bigint::operator/(const bigint& n) const {
-    return bigint(*this) /= n;
+bigint& bigint::submul(const bigint& a, const bigint& b) {
+    return *this -= a * b;
 }
 
-// TODO
-bigint bigint::operator%(const bigint& n) const {
-    return *this;
+/* division */
+// returns {*this / n, *this % n}
+std::pair<bigint, bigint> bigint::divmod(const bigint& n) const {
+    assert(!!n);
+    bigint q, r;
+    divmod_abs(*this, n, q, r);
+    q.sign = static_cast<Sign>(sign * n.sign);
+    r.sign = sign;
+    q.trim();
+    r.trim();
+    return {std::move(q), std::move(r)};
 }
 
-bigint bigint::operator-() const {
-    bigint neg(*this);
-    if (*this == 0) {
-        neg.sign = POSITIVE;
-        return neg;
+/* q = abs(a) / abs(b), r = abs(a) % abs(b), b != 0
+ * q and r may alias a or b.
+ */
+void bigint::divmod_abs(const bigint& a, const bigint& b, bigint& q, bigint& r) {
+    const std::size_t n = a.value.size();
+    const std::size_t m = b.value.size();
+    if (gt_abs(b, a)) {
+        r = a.abs();
+        q = bigint(0);
+        return;
+    }
+
+    bigint quot(0);
+    bigint rem(0);
+    if (m == 1) {
+        quot.value.resize(n);
+        rem.value[0] = divrem_1(quot.value.data(), a.value.data(), n, b.value[0]);
+    }
+    else if (m < bz_cutoff || n - m < bz_cutoff) {
+        quot.value.resize(n - m + 1);
+        rem.value.resize(m);
+        divrem_knuth(quot.value.data(), rem.value.data(), a.value.data(), n, b.value.data(), m);
+    }
+    else {
+        divmod_bz(a.abs(), b.abs(), quot, rem);
+    }
+    quot.trim();
+    rem.trim();
+    q = std::move(quot);
+    r = std::move(rem);
+}
+
+/* Burnikel-Ziegler recursive division, "Fast Recursive Division" (1998)
+ * a >= b > 0. The dividend is split into digits of base^n, n being the length
+ * of the divisor in limbs, and each of them is divided with div2n1n.
+ */
+void bigint::divmod_bz(bigint a, bigint b, bigint& q, bigint& r) {
+    // normalize so that the top limb of the divisor has its highest bit set
+    const unsigned s = __builtin_clzll(b.value.back());
+    a.shl_bits(s);
+    b.shl_bits(s);
+
+    const std::size_t n = b.value.size();
+    const std::size_t chunks = (a.value.size() + n - 1) / n;
+    bigint quot(0);
+    bigint rem(0);
+    quot.value.assign(chunks * n, 0);
+    for (std::size_t i = chunks; i-- > 0;) {
+        bigint cur(rem);
+        cur.shl_limbs(n);
+        cur += slice(a, i * n, (i + 1) * n);
+        bigint qi;
+        div2n1n(cur, b, n, qi, rem);
+        std::copy(qi.value.begin(), qi.value.end(), quot.value.begin() + i * n);
+    }
+    quot.trim();
+    rem.shr_bits(s);
+    q = std::move(quot);
+    r = std::move(rem);
+}
+
+// a < base^n * b, b has exactly n limbs and is normalized
+void bigint::div2n1n(const bigint& a, const bigint& b, std::size_t n, bigint& q, bigint& r) {
+    if (n < std::max<std::size_t>(bz_cutoff, 2)) {
+        divmod_abs(a, b, q, r);
+        return;
+    }
+
+    // an odd n is padded with a zero limb, which keeps b normalized
+    const bool pad = n & 1;
+    bigint ap(a);
+    bigint bp(b);
+    if (pad) {
+        ap.shl_limbs(1);
+        bp.shl_limbs(1);
+        ++n;
+    }
+
+    const std::size_t half = n / 2;
+    const bigint b1 = slice(bp, half, n);
+    const bigint b2 = slice(bp, 0, half);
+    bigint q1;
+    bigint q2;
+    bigint rem;
+    div3n2n(slice(ap, n, ap.value.size()), slice(ap, half, n), bp, b1, b2, half, q1, rem);
+    div3n2n(rem, slice(ap, 0, half), bp, b1, b2, half, q2, rem);
+    if (pad) {
+        rem = slice(rem, 1, rem.value.size());
+    }
+
+    q1.shl_limbs(half);
+    q = std::move(q1 += q2);
+    r = std::move(rem);
+}
+
+// divides [a12, a3] (3 halves) by b = [b1, b2] (2 halves), each half n limbs
+void bigint::div3n2n(const bigint& a12, const bigint& a3, const bigint& b,
+                     const bigint& b1, const bigint& b2, std::size_t n, bigint& q, bigint& r) {
+    bigint rem;
+    if (slice(a12, n, a12.value.size()) == b1) {
+        // the quotient would be >= base^n, base^n - 1 is at most 2 too large
+        q.value.assign(n, ~uint64(0));
+        q.sign = POSITIVE;
+        bigint b1s(b1);
+        b1s.shl_limbs(n);
+        rem = a12 - b1s + b1;
+    }
+    else {
+        div2n1n(a12, b1, n, q, rem);
+    }
+    rem.shl_limbs(n);
+    rem += a3;
+    rem -= q * b2;
+    while (rem.sign == NEGATIVE) {
+        q -= 1;
+        rem += b;
+    }
+    r = std::move(rem);
+}
+
+// removes leading zero limbs, zero is always positive
+void bigint::trim() {
+    while (value.size() > 1 && value.back() == 0) {
+        value.pop_back();
+    }
+    if (value.size() == 1 && value[0] == 0) {
+        sign = POSITIVE;
+    }
+}
+
+// limbs [lo, hi) of abs(n)
+bigint bigint::slice(const bigint& n, std::size_t lo, std::size_t hi) {
+    bigint s(0);
+    hi = std::min(hi, n.value.size());
+    if (lo < hi) {
+        s.value.assign(n.value.begin() + lo, n.value.begin() + hi);
+        s.trim();
+    }
+    return s;
+}
+
+// *this *= base^k
+void bigint::shl_limbs(std::size_t k) {
+    if (value.size() > 1 || value[0]) {
+        value.insert(value.begin(), k, 0);
+    }
+}
+
+// *this <<= s, s < b_exp
+void bigint::shl_bits(unsigned s) {
+    uint64 out = lshift(value.data(), value.data(), value.size(), s);
+    if (out) {
+        value.emplace_back(out);
+    }
+}
+
+// *this >>= s, s < b_exp
+void bigint::shr_bits(unsigned s) {
+    rshift(value.data(), value.data(), value.size(), s);
+    trim();
+}
+
+/* expression evaluation
+ * Terms are summed into a w limb two's complement accumulator, w exceeds
+ * every term by a limb so no intermediate result can overflow it.
+ */
+// acc = s * abs(x) if first, acc += s * abs(x) otherwise
+void bigint::acc_add(uint64* acc, std::size_t w, const bigint& x, int s, bool first) {
+    const std::size_t n = x.value.size();
+    if (first) {
+        std::copy(x.value.begin(), x.value.end(), acc);
+        std::fill(acc + n, acc + w, 0);
+        if (s < 0) {
+            neg_in(acc, w);
+        }
+    }
+    else if (s > 0) {
+        add_in(acc, w, x.value.data(), n);
+    }
+    else {
+        sub_in(acc, w, x.value.data(), n);
+    }
+}
+
+// acc = s * abs(x*y) if first, acc += s * abs(x*y) otherwise
+void bigint::acc_addmul(uint64* acc, std::size_t w, const bigint& x, const bigint& y, int s, bool first) {
+    const uint64* a = x.value.data();
+    const uint64* b = y.value.data();
+    std::size_t n = x.value.size();
+    std::size_t m = y.value.size();
+    if (n < m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+
+    if (first) {
+        mul(acc, a, n, b, m);
+        std::fill(acc + n + m, acc + w, 0);
+        if (s < 0) {
+            neg_in(acc, w);
+        }
+    }
+    else if (m < std::max(karatsuba_cutoff, min_cutoff) && a != b) {
+        // multiply-accumulate a row at a time, no product is formed
+        for (std::size_t i = 0; i < m; ++i) {
+            if (s > 0) {
+                uint64 c = addmul_1(acc + i, a, n, b[i]);
+                add_in(acc + i + n, w - i - n, &c, 1);
+            }
+            else {
+                uint64 c = submul_1(acc + i, a, n, b[i]);
+                sub_in(acc + i + n, w - i - n, &c, 1);
+            }
+        }
+    }
+    else {
+        scratch p(n + m);
+        mul(p.data(), a, n, b, m);
+        if (s > 0) {
+            add_in(acc, w, p.data(), n + m);
+        }
+        else {
+            sub_in(acc, w, p.data(), n + m);
+        }
+    }
+}
+
+// widens *this to a w limb two's complement accumulator
+void bigint::acc_start(std::size_t w) {
+    value.resize(w, 0);
+    if (sign == NEGATIVE) {
+        neg_in(value.data(), w);
+    }
+}
+
+// back from two's complement to sign and magnitude
+void bigint::acc_finish() {
+    sign = POSITIVE;
+    if (value.back() >> (b_exp - 1)) {
+        neg_in(value.data(), value.size());
+        sign = NEGATIVE;
+    }
+    trim();
+}
+
+bigint bigint::operator-() const& {
+    return -bigint(*this);
+}
+
+bigint bigint::operator-() && {
+    if (!!*this) {
+        sign = sign == POSITIVE ? NEGATIVE : POSITIVE;
     }
-    neg.sign = sign == POSITIVE ? NEGATIVE : POSITIVE;
-    return neg;
+    return std::move(*this);
 }
 
 // returns abs(a) > abs(b)
@@ -203,52 +1424,46 @@ bool bigint::gt_abs(const bigint& a, const bigint& b) {
     return false;
 }
 
-bool bigint::operator>(const bigint& n) const {
-    if (sign != n.sign) {
-        return sign > n.sign;
+bool operator>(const bigint& a, const bigint& b) {
+    if (a.sign != b.sign) {
+        return a.sign > b.sign;
     }
-    else if (sign == POSITIVE) {
-        return gt_abs(*this, n);
+    else if (a.sign == bigint::POSITIVE) {
+        return bigint::gt_abs(a, b);
     }
     else {
-        return gt_abs(n, *this);
+        return bigint::gt_abs(b, a);
     }
 }
 
-bool bigint::operator<(const bigint& n) const {
-    return n > *this;
+bool operator<(const bigint& a, const bigint& b) {
+    return b > a;
 }
 
-bool bigint::operator>=(const bigint& n) const {
-    return !(n > *this);
+bool operator>=(const bigint& a, const bigint& b) {
+    return !(b > a);
 }
 
-bool bigint::operator<=(const bigint& n) const {
-    return !(*this > n);
+bool operator<=(const bigint& a, const bigint& b) {
+    return !(a > b);
 }
 
-bool bigint::operator==(const bigint& n) const {
-    return !(*this > n) && !(n > *this);
+bool operator==(const bigint& a, const bigint& b) {
+    return a.sign == b.sign && a.value.size() == b.value.size() &&
+           std::equal(a.value.begin(), a.value.end(), b.value.begin());
 }
 
-bool bigint::operator!=(const bigint& n) const {
-    return !(*this == n);
+bool operator!=(const bigint& a, const bigint& b) {
+    return !(a == b);
 }
 
 bool bigint::operator!() const {
-    return *this == 0;
+    return value.size() == 1 && value[0] == 0;
 }
 
 // converts int/uint64/int64 n >= 0 -> bigint
 void bigint::convert(uint64 n) {
-    if (!n) {
-        value.emplace_back(0);
-    }
-    while (n) {
-        uint64 r = n & mask;
-        n >>= b_exp;
-        value.emplace_back(r);
-    }
+    value.emplace_back(n);
 }
 
 bigint bigint::abs() const {
@@ -257,16 +1472,391 @@ bigint bigint::abs() const {
     return abs;
 }
 
-// TODO base 10
-std::string bigint::tostring(int str_len) const {
+/* Montgomery arithmetic */
+bigint::montgomery::montgomery(const bigint& m, bool constant_time)
+    : n(m.abs()), k(m.value.size()), r2(k), one(k), ct(constant_time) {
+    assert((m.value[0] & 1) && (k > 1 || m.value[0] > 1));
+    // Newton iteration for n^-1 mod base, correct to 3 bits for odd n and
+    // doubling every step
+    uint64 inv = m.value[0];
+    for (int i = 0; i < 5; ++i) {
+        inv *= 2 - m.value[0] * inv;
+    }
+    ninv = 0 - inv;
+
+    bigint r(1);
+    r.shl_limbs(k);
+    load(r % n, one.data());
+    r.shl_limbs(k);
+    load(r % n, r2.data());
+}
+
+// a < n into k limbs
+void bigint::montgomery::load(const bigint& a, uint64* r) const {
+    std::copy(a.value.begin(), a.value.end(), r);
+    std::fill(r + a.value.size(), r + k, 0);
+}
+
+bigint bigint::montgomery::store(const uint64* r) const {
+    bigint x;
+    x.value.assign(r, r + k);
+    x.trim();
+    return x;
+}
+
+// r = a*b/R mod n, t is scratch of 2k + 1 limbs
+void bigint::montgomery::mul_limbs(uint64* r, const uint64* a, const uint64* b, uint64* t) const {
+    if (ct || (a != b && k < std::max(karatsuba_cutoff, min_cutoff))) {
+        mont_cios(r, a, b, t, n.value.data(), k, ninv, ct);
+        return;
+    }
+    if (a == b) {
+        ::sqr(t, a, k);
+    }
+    else {
+        ::mul(t, a, k, b, k);
+    }
+    t[2 * k] = 0;
+    mont_redc(r, t, n.value.data(), k, ninv);
+}
+
+bigint bigint::montgomery::to(const bigint& a) const {
+    bigint b = a % n;
+    if (b.sign == NEGATIVE) {
+        b += n;
+    }
+    scratch x(k), t(2 * k + 1);
+    load(b, x.data());
+    mul_limbs(x.data(), x.data(), r2.data(), t.data());
+    return store(x.data());
+}
+
+bigint bigint::montgomery::from(const bigint& a) const {
+    scratch x(k), unit(k), t(2 * k + 1);
+    load(a, x.data());
+    std::fill(unit.begin(), unit.end(), 0);
+    unit[0] = 1;
+    mul_limbs(x.data(), x.data(), unit.data(), t.data());
+    return store(x.data());
+}
+
+bigint bigint::montgomery::mul(const bigint& a, const bigint& b) const {
+    scratch x(k), y(k), t(2 * k + 1);
+    load(a, x.data());
+    load(b, y.data());
+    mul_limbs(x.data(), x.data(), y.data(), t.data());
+    return store(x.data());
+}
+
+bigint bigint::montgomery::sqr(const bigint& a) const {
+    scratch x(k), t(2 * k + 1);
+    load(a, x.data());
+    mul_limbs(x.data(), x.data(), x.data(), t.data());
+    return store(x.data());
+}
+
+bigint bigint::montgomery::pow(const bigint& a, const bigint& e) const {
+    assert(e.sign == POSITIVE);
+    auto bit = [&e](std::size_t i) {
+        return e.value[i / b_exp] >> (i % b_exp) & 1;
+    };
+    scratch acc(k), t(2 * k + 1);
+
+    if (ct) {
+        // fixed windows over every limb of e, each multiplication takes an
+        // entry found by scanning the whole table of a^0 .. a^(2^w - 1)
+        const std::size_t bits = e.value.size() * b_exp;
+        const unsigned w = bits > 256 ? 5 : 4;
+        const std::size_t entries = std::size_t(1) << w;
+        scratch tab(entries * k), sel(k);
+        std::copy(one.begin(), one.end(), tab.begin());
+        load(to(a), tab.data() + k);
+        for (std::size_t j = 2; j < entries; ++j) {
+            mul_limbs(tab.data() + j * k, tab.data() + (j - 1) * k, tab.data() + k, t.data());
+        }
+        std::copy(one.begin(), one.end(), acc.begin());
+        for (std::size_t i = (bits + w - 1) / w; i-- > 0;) {
+            const std::size_t lo = i * w;
+            const std::size_t hi = std::min(lo + w, bits);
+            uint64 win = 0;
+            for (std::size_t j = hi; j-- > lo;) {
+                mul_limbs(acc.data(), acc.data(), acc.data(), t.data());
+                win = win << 1 | bit(j);
+            }
+            std::fill(sel.begin(), sel.end(), 0);
+            for (std::size_t j = 0; j < entries; ++j) {
+                const uint64 mask = 0 - static_cast<uint64>(j == win);
+                for (std::size_t l = 0; l < k; ++l) {
+                    sel[l] |= tab[j * k + l] & mask;
+                }
+            }
+            mul_limbs(acc.data(), acc.data(), sel.data(), t.data());
+        }
+        return from(store(acc.data()));
+    }
+
+    if (!e) {
+        return bigint(1);
+    }
+    // sliding windows of up to w bits, each ending in a set bit, and a table
+    // of the odd powers a, a^3, .., a^(2^w - 1)
+    const std::size_t bits = e.value.size() * b_exp - __builtin_clzll(e.value.back());
+    const unsigned w = bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 : 1;
+    const std::size_t entries = std::size_t(1) << (w - 1);
+    scratch tab(entries * k), sq(k);
+    load(to(a), tab.data());
+    if (entries > 1) {
+        mul_limbs(sq.data(), tab.data(), tab.data(), t.data());
+    }
+    for (std::size_t j = 1; j < entries; ++j) {
+        mul_limbs(tab.data() + j * k, tab.data() + (j - 1) * k, sq.data(), t.data());
+    }
+
+    bool started = false;
+    std::size_t i = bits;
+    while (i > 0) {
+        if (!bit(i - 1)) {
+            mul_limbs(acc.data(), acc.data(), acc.data(), t.data());
+            --i;
+            continue;
+        }
+        // window e[l..i) with its lowest bit set
+        std::size_t l = i > w ? i - w : 0;
+        while (!bit(l)) {
+            ++l;
+        }
+        uint64 win = 0;
+        for (std::size_t j = i; j-- > l;) {
+            win = win << 1 | bit(j);
+        }
+        const uint64* p = tab.data() + (win >> 1) * k;
+        if (started) {
+            for (std::size_t j = l; j < i; ++j) {
+                mul_limbs(acc.data(), acc.data(), acc.data(), t.data());
+            }
+            mul_limbs(acc.data(), acc.data(), p, t.data());
+        }
+        else {
+            std::copy(p, p + k, acc.begin());
+            started = true;
+        }
+        i = l;
+    }
+    return from(store(acc.data()));
+}
+
+bigint mod_exp(const bigint& a, const bigint& e, const bigint& m) {
+    assert(!!m && e.sign == bigint::POSITIVE);
+    const bigint mod = m.abs();
+    if (mod.value.size() == 1 && mod.value[0] == 1) {
+        return bigint(0);
+    }
+    if (mod.value[0] & 1) {
+        return bigint::montgomery(mod).pow(a, e);
+    }
+
+    // even modulus, left to right square and multiply
+    bigint base = a % mod;
+    if (base.sign == bigint::NEGATIVE) {
+        base += mod;
+    }
+    bigint r(1);
+    for (std::size_t i = e.value.size() * bigint::b_exp; i-- > 0;) {
+        r *= r;
+        r %= mod;
+        if (e.value[i / bigint::b_exp] >> (i % bigint::b_exp) & 1) {
+            r *= base;
+            r %= mod;
+        }
+    }
+    return r;
+}
+
+/* string conversion
+ * Decimal conversion works on chunks of 19 digits (10^19 < base). Numbers
+ * longer than radix_cutoff limbs are split in halves by a power
+ * 10^(19*2^k) and both halves are converted recursively, which makes the
+ * conversion as fast as the division/multiplication underneath.
+ */
+namespace {
+constexpr uint64 chunk_pow = 10000000000000000000ULL; // 10^19
+constexpr std::size_t chunk_len = 19;
+constexpr std::size_t radix_cutoff = 20;
+} // namespace
+
+// 10^(19*2^k), cached per thread
+const bigint& bigint::pow10_chunk(std::size_t k) {
+    thread_local std::vector<bigint> cache{bigint(static_cast<std::uint64_t>(chunk_pow))};
+    // the cache outlives any arena
+    heap_scope heap;
+    while (cache.size() <= k) {
+        cache.emplace_back(cache.back() * cache.back());
+    }
+    return cache[k];
+}
+
+bigint::bigint(std::string s) {
+    if (!parse(s, *this)) {
+        throw std::invalid_argument("bigint: invalid number \"" + s + "\"");
+    }
+}
+
+/* Accepts an optional sign followed by decimal digits or by "0x" and
+ * hexadecimal digits. Returns false and leaves n untouched on malformed input.
+ */
+bool bigint::parse(const std::string& s, bigint& n) {
+    std::size_t i = 0;
+    const bool neg = !s.empty() && s[0] == '-';
+    if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+        ++i;
+    }
+    const bool hex = s.compare(i, 2, "0x") == 0 || s.compare(i, 2, "0X") == 0;
+    if (hex) {
+        i += 2;
+    }
+    if (i == s.size()) {
+        return false;
+    }
+    for (std::size_t j = i; j < s.size(); ++j) {
+        if (hex ? !std::isxdigit(static_cast<unsigned char>(s[j])) : !std::isdigit(static_cast<unsigned char>(s[j]))) {
+            return false;
+        }
+    }
+
+    bigint r(0);
+    if (hex) {
+        const std::size_t shift = 4;
+        const std::size_t len = s.size() - i;
+        r.value.assign((len * shift + b_exp - 1) / b_exp, 0);
+        for (std::size_t j = 0; j < len; ++j) {
+            const char c = s[s.size() - 1 - j];
+            const uint64 d = std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (std::tolower(c) - 'a' + 10);
+            r.value[j * shift / b_exp] |= d << (j * shift % b_exp);
+        }
+    }
+    else {
+        r = from_decimal(s.data() + i, s.size() - i);
+    }
+    r.trim();
+    if (neg && !!r) {
+        r.sign = NEGATIVE;
+    }
+    n = std::move(r);
+    return true;
+}
+
+// s[0..len) decimal digits -> bigint
+bigint bigint::from_decimal(const char* s, std::size_t len) {
+    if (len > radix_cutoff * chunk_len) {
+        // lo = last 19*2^k digits, hi = the rest
+        std::size_t k = 0;
+        while (chunk_len << (k + 1) < len) {
+            ++k;
+        }
+        const std::size_t lo_len = chunk_len << k;
+        bigint r = from_decimal(s, len - lo_len);
+        r *= pow10_chunk(k);
+        return r += from_decimal(s + len - lo_len, lo_len);
+    }
+
+    bigint r(0);
+    std::size_t i = 0;
+    std::size_t step = len % chunk_len ? len % chunk_len : chunk_len;
+    while (i < len) {
+        uint64 chunk = 0;
+        uint64 scale = 1;
+        for (std::size_t j = 0; j < step; ++j) {
+            chunk = chunk * 10 + (s[i+j] - '0');
+            scale *= 10;
+        }
+        uint64 carry = mul_1(r.value.data(), r.value.data(), r.value.size(), scale, chunk);
+        if (carry) {
+            r.value.emplace_back(carry);
+        }
+        i += step;
+        step = chunk_len;
+    }
+    r.trim();
+    return r;
+}
+
+// appends the decimal digits of abs(x) to s, zero padded to width
+void bigint::to_decimal(const bigint& x, std::string& s, std::size_t width) {
+    const std::size_t n = x.value.size();
+    if (n > radix_cutoff) {
+        // largest k with 10^(19*2^k) at most half as long as x
+        std::size_t k = 0;
+        while (2 * pow10_chunk(k + 1).value.size() <= n + 1) {
+            ++k;
+        }
+        const std::size_t lo_width = chunk_len << k;
+        auto [hi, lo] = x.abs().divmod(pow10_chunk(k));
+        to_decimal(hi, s, width > lo_width ? width - lo_width : 0);
+        to_decimal(lo, s, lo_width);
+        return;
+    }
+
+    // repeatedly divide by 10^19, chunks come out least significant first
+    scratch t(n);
+    scratch chunks(n * 20 / chunk_len + 1);
+    std::copy(x.value.begin(), x.value.end(), t.begin());
+    std::size_t len = n;
+    std::size_t count = 0;
+    while (len > 1 || t[0]) {
+        chunks[count++] = divrem_1(t.data(), t.data(), len, chunk_pow);
+        while (len > 1 && t[len-1] == 0) {
+            --len;
+        }
+    }
+
+    char buf[chunk_len];
+    std::size_t digits = 0;
+    std::string body{};
+    body.reserve(count * chunk_len);
+    for (std::size_t i = count; i-- > 0;) {
+        uint64 c = chunks[i];
+        std::size_t j = chunk_len;
+        while (j > 0 && (c || i + 1 != count)) {
+            buf[--j] = static_cast<char>('0' + c % 10);
+            c /= 10;
+        }
+        body.append(buf + j, chunk_len - j);
+        digits += chunk_len - j;
+    }
+    if (width > digits) {
+        s.append(width - digits, '0');
+    }
+    s += body;
+}
+
+std::string bigint::tostring(int str_len, int base) const {
+    assert(base == 10 || base == 16);
     if (str_len < 0) {
         return "Negative str_len\n";
     }
+    std::string s{};
+    if (base == 10) {
+        if (!*this) {
+            return "0";
+        }
+        s.reserve(value.size() * 20 + 1);
+        if (sign == NEGATIVE) {
+            s += "-";
+            if (str_len) {
+                ++str_len;
+            }
+        }
+        to_decimal(*this, s, 0);
+        if (str_len && s.length() > static_cast<std::size_t>(str_len)) {
+            s.resize(str_len);
+        }
+        return s;
+    }
+
     static const char* hex_c = "0123456789abcdef";
     int shift = 4;
-    std::string s{};
     s.reserve(value.size() * b_exp / shift);
-    if (*this == bigint(0)) {
+    if (!*this) {
         return s + "0x0"; 
     }
     if (sign == NEGATIVE) {
@@ -287,8 +1877,21 @@ std::string bigint::tostring(int str_len) const {
             s += c;
         }
     }
-    if (str_len && s.length() >= str_len + 2) { 
+    if (str_len && s.length() >= static_cast<std::size_t>(str_len) + 2) { 
         return s.substr(0, str_len + 2);
     }
     return s;
 }
+
+/* streams, std::hex selects hexadecimal output */
+std::istream& operator>>(std::istream& in, bigint& n) {
+    std::string s;
+    if (in >> s && !bigint::parse(s, n)) {
+        in.setstate(std::ios::failbit);
+    }
+    return in;
+}
+
+std::ostream& operator<<(std::ostream& out, const bigint& n) {
+    return out << n.tostring(0, out.flags() & std::ios::hex ? 16 : 10);
+}
@@ -1,11 +1,19 @@
 #pragma once 
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <istream>
 #include <ostream>
 
 class bigint {
+    public:
+        class arena;
+
     private:
         using uint32 = std::uint32_t;
         using int64 = std::int64_t;
@@ -16,57 +24,530 @@ class bigint {
             POSITIVE = 1
         };
 
-        static constexpr uint64 b_exp = 32;
-        static constexpr uint64 base = 0x1ULL << b_exp;
-        static constexpr uint64 mask = base - 1;
+        static constexpr unsigned b_exp = 64; // bits per limb
+
+        /* Limb storage with a small inline buffer, numbers of up to
+         * inline_limbs limbs never touch the heap. A vector created while an
+         * arena is installed on this thread takes its larger buffers from
+         * that arena, as long as it is still the installed one; all others
+         * use new[]. Heap storage stays on the heap, and pooled limbs moved
+         * into a vector of another arena or of the heap are copied. Provides
+         * the subset of std::vector used by bigint, iterators are plain
+         * pointers.
+         */
+        class limb_vector {
+            public:
+                static constexpr std::size_t inline_limbs = 2;
+
+                limb_vector() noexcept : len(0), cap(inline_limbs), pool(active_arena) {}
+                limb_vector(const limb_vector& v) : limb_vector() {
+                    assign(v.begin(), v.end());
+                }
+                // copying pooled limbs cannot fail short of running out of
+                // memory, which terminates
+                limb_vector(limb_vector&& v) noexcept : limb_vector() {
+                    steal(v);
+                }
+                ~limb_vector() {
+                    release();
+                }
+
+                limb_vector& operator=(const limb_vector& v) {
+                    if (this != &v) {
+                        assign(v.begin(), v.end());
+                    }
+                    return *this;
+                }
+                limb_vector& operator=(limb_vector&& v) noexcept {
+                    if (this != &v) {
+                        release();
+                        steal(v);
+                    }
+                    return *this;
+                }
+
+                std::size_t size() const noexcept { return len; }
+                bool empty() const noexcept { return len == 0; }
+                uint64* data() noexcept { return is_inline() ? local : heap; }
+                const uint64* data() const noexcept { return is_inline() ? local : heap; }
+                uint64* begin() noexcept { return data(); }
+                uint64* end() noexcept { return data() + len; }
+                const uint64* begin() const noexcept { return data(); }
+                const uint64* end() const noexcept { return data() + len; }
+                uint64& operator[](std::size_t i) noexcept { return data()[i]; }
+                uint64 operator[](std::size_t i) const noexcept { return data()[i]; }
+                uint64& back() noexcept { return data()[len-1]; }
+                uint64 back() const noexcept { return data()[len-1]; }
+
+                // grows geometrically, the contents are kept
+                void reserve(std::size_t n) {
+                    if (n > cap) {
+                        grow(n);
+                    }
+                }
+                void resize(std::size_t n, uint64 v = 0) {
+                    reserve(n);
+                    if (n > len) {
+                        std::fill(data() + len, data() + n, v);
+                    }
+                    len = n;
+                }
+                void assign(std::size_t n, uint64 v) {
+                    len = 0;
+                    resize(n, v);
+                }
+                // [first, last) must not point into *this
+                void assign(const uint64* first, const uint64* last) {
+                    len = 0;
+                    reserve(last - first);
+                    std::copy(first, last, data());
+                    len = last - first;
+                }
+                uint64* insert(uint64* pos, std::size_t k, uint64 v) {
+                    const std::size_t i = pos - data();
+                    reserve(len + k);
+                    uint64* p = data();
+                    std::copy_backward(p + i, p + len, p + len + k);
+                    std::fill(p + i, p + i + k, v);
+                    len += k;
+                    return p + i;
+                }
+                void emplace_back(uint64 v) {
+                    if (len == cap) {
+                        reserve(len + 1);
+                    }
+                    data()[len++] = v;
+                }
+                void pop_back() noexcept { --len; }
+                void clear() noexcept { len = 0; }
+
+            private:
+                bool is_inline() const noexcept { return cap == inline_limbs; }
+                void grow(std::size_t n);
+                void release() noexcept {
+                    // arena memory is given back by arena::reset()
+                    if (!is_inline() && !pool) {
+                        delete[] heap;
+                    }
+                    cap = inline_limbs;
+                }
+                // takes over the storage of v, which is left empty; pooled
+                // limbs are only taken over within their own arena
+                void steal(limb_vector& v) noexcept {
+                    if (!v.is_inline() && v.pool && v.pool != pool) {
+                        assign(v.begin(), v.end());
+                        v.len = 0;
+                        return;
+                    }
+                    len = v.len;
+                    if (v.is_inline()) {
+                        std::copy(v.local, v.local + v.len, local);
+                    }
+                    else {
+                        heap = v.heap;
+                        cap = v.cap;
+                        pool = v.pool;
+                        v.cap = inline_limbs;
+                    }
+                    v.len = 0;
+                }
+
+                std::uint32_t len;
+                std::uint32_t cap;
+                // arena of the buffer, nullptr for the heap; an inline vector
+                // keeps the arena it was created under
+                arena* pool;
+                union {
+                    uint64* heap;
+                    uint64 local[inline_limbs];
+                };
+        };
 
         Sign sign;
-        std::vector<uint64> value{};
+        limb_vector value{}; // limbs, least significant first
 
         void convert(uint64 n);
+        void trim();
+        bigint& add_signed(const bigint& n, Sign n_sign);
+        void shl_limbs(std::size_t k);
+        void shl_bits(unsigned s);
+        void shr_bits(unsigned s);
         static bool gt_abs(const bigint& a, const bigint& b);
+        static bigint slice(const bigint& n, std::size_t lo, std::size_t hi);
+
+        static bool parse(const std::string& s, bigint& n);
+        static bigint from_decimal(const char* s, std::size_t len);
+        static void to_decimal(const bigint& x, std::string& s, std::size_t width);
+
+        // two's complement accumulation for the expression templates
+        static void acc_add(uint64* acc, std::size_t w, const bigint& x, int s, bool first);
+        static void acc_addmul(uint64* acc, std::size_t w, const bigint& x, const bigint& y,
+                               int s, bool first);
+        void acc_start(std::size_t w);
+        void acc_finish();
+
+        static void divmod_abs(const bigint& a, const bigint& b, bigint& q, bigint& r);
+        static void divmod_bz(bigint a, bigint b, bigint& q, bigint& r);
+        static void div2n1n(const bigint& a, const bigint& b, std::size_t n, bigint& q, bigint& r);
+        static void div3n2n(const bigint& a12, const bigint& a3, const bigint& b,
+                            const bigint& b1, const bigint& b2, std::size_t n, bigint& q, bigint& r);
 
     public:
+        /* Bump allocator for limbs. Memory is carved out of chunks that are
+         * kept for reuse; it is given back all at once by reset(), or down to
+         * an earlier mark() by rewind(). Not thread safe, use one per thread.
+         */
+        class arena {
+            public:
+                struct position {
+                    std::size_t chunk;
+                    std::size_t offset;
+                };
+
+                explicit arena(std::size_t chunk_limbs = 1 << 12);
+                ~arena();
+                arena(const arena&) = delete;
+                arena& operator=(const arena&) = delete;
+
+                uint64* allocate(std::size_t n);
+                position mark() const noexcept { return top; }
+                void rewind(position p) noexcept { top = p; }
+                void reset() noexcept { top = {0, 0}; }
+
+            private:
+                struct chunk {
+                    uint64* data;
+                    std::size_t size;
+                };
+                std::vector<chunk> chunks{};
+                position top{0, 0};
+                std::size_t chunk_limbs;
+        };
+
+        /* Makes bigints created on this thread take their limbs from a,
+         * until the scope ends. Such values must not be read after
+         * a.reset(). Bigints from outside the scope keep their limbs on the
+         * heap, also when assigned or moved a pooled value, so results can
+         * be stored in them directly. Scopes nest, a bigint only grows in
+         * the arena of the scope it was created in.
+         */
+        class arena_scope {
+            public:
+                explicit arena_scope(arena& a) noexcept;
+                ~arena_scope();
+                arena_scope(const arena_scope&) = delete;
+                arena_scope& operator=(const arena_scope&) = delete;
+
+            private:
+                arena* prev;
+        };
+
+    private:
+        // arena installed on this thread by arena_scope
+        static inline thread_local arena* active_arena = nullptr;
+
+        class heap_scope;
+        static const bigint& pow10_chunk(std::size_t k);
+
+    public:
+        /* Expression templates
+         * +, - and * build a small expression tree instead of a temporary per
+         * operator. Assigning it to a bigint evaluates the whole sum of
+         * products in one pass over the destination's storage: products are
+         * multiply-accumulated, signs are handled in two's complement and the
+         * result is normalized once at the end. Named operands are held by
+         * reference and temporaries by value, so an expression stays valid as
+         * long as the named bigints it uses do. Factors of a product that are
+         * themselves expressions are evaluated when the product is formed.
+         */
+        template <class E>
+        struct expr {
+            const E& self() const noexcept { return static_cast<const E&>(*this); }
+            bigint eval() const { return bigint(*this); }
+            std::pair<bigint, bigint> divmod(const bigint& n) const { return eval().divmod(n); }
+            bigint abs() const { return eval().abs(); }
+            std::string tostring(int str_len = 0, int base = 10) const {
+                return eval().tostring(str_len, base);
+            }
+            bool operator!() const { return !eval(); }
+        };
+
+        // leaf, T is const bigint& or bigint
+        template <class T>
+        struct operand {
+            T v;
+        };
+
+        template <class A, class B>
+        struct product : expr<product<A, B>> {
+            A a;
+            B b;
+            product(A a, B b) : a(std::move(a)), b(std::move(b)) {}
+        };
+
+        // a + b for S == 1, a - b for S == -1
+        template <class A, class B, int S>
+        struct sum : expr<sum<A, B, S>> {
+            A a;
+            B b;
+            sum(A a, B b) : a(std::move(a)), b(std::move(b)) {}
+        };
+
+        template <class A>
+        struct negation : expr<negation<A>> {
+            A a;
+            explicit negation(A a) : a(std::move(a)) {}
+        };
+
+        template <class T>
+        static constexpr bool is_expr = std::is_base_of_v<expr<std::decay_t<T>>, std::decay_t<T>>;
+        template <class T>
+        static constexpr bool is_arg = std::is_same_v<std::decay_t<T>, bigint> || is_expr<T>;
+        // +, - and * take bigints, expressions and built-in integers, not only the latter
+        template <class A, class B>
+        static constexpr bool are_args = (is_arg<A> || std::is_integral_v<std::decay_t<A>>) &&
+                                         (is_arg<B> || std::is_integral_v<std::decay_t<B>>) &&
+                                         (is_arg<A> || is_arg<B>);
+
+        // wraps an argument of +, - or * as a term of the expression
+        static operand<const bigint&> term(const bigint& x) { return {x}; }
+        static operand<bigint> term(bigint&& x) { return {std::move(x)}; }
+        template <class T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+        static operand<bigint> term(T x) {
+            if constexpr (std::is_signed_v<T>) return {bigint(static_cast<int64>(x))};
+            else return {bigint(static_cast<uint64>(x))};
+        }
+        template <class E, std::enable_if_t<is_expr<E>, int> = 0>
+        static std::decay_t<E> term(E&& e) { return std::forward<E>(e); }
+
+        // as term(), but products only multiply leaves
+        template <class T>
+        static auto factor(T&& x) {
+            if constexpr (is_expr<T>) return operand<bigint>{bigint(x)};
+            else return term(std::forward<T>(x));
+        }
+
+        class montgomery;
+
+        // operand lengths (in limbs) at which multiplication switches from
+        // schoolbook to Karatsuba, from Karatsuba to Toom-3 and from Toom-3
+        // to the number-theoretic transform
+        static std::size_t karatsuba_cutoff;
+        static std::size_t toom3_cutoff;
+        static std::size_t karatsuba_sqr_cutoff;
+        static std::size_t toom3_sqr_cutoff;
+        static std::size_t ntt_cutoff;
+        // divisor length (in limbs) from which Burnikel-Ziegler division is used
+        static std::size_t bz_cutoff;
+        // threads a single multiplication may use, 1 keeps it serial, and the
+        // operand length (in limbs) from which its sub-products are split
+        // between them; set both before multiplying
+        static unsigned threads;
+        static std::size_t parallel_cutoff;
+
         bigint(int n = 0);
         bigint(int64 n);
         bigint(uint64 n);
         bigint(const bigint& n);
+        bigint(bigint&& n) noexcept;
         bigint(std::string s);
+        template <class E>
+        bigint(const expr<E>& e) : sign(POSITIVE) {
+            evaluate(e.self(), 1, false);
+        }
 
         bigint& operator=(int n);
         bigint& operator=(int64 n);
         bigint& operator=(const bigint& n);
-        bigint& operator=(bigint&& n);
+        bigint& operator=(bigint&& n) noexcept;
+        template <class E>
+        bigint& operator=(const expr<E>& e) {
+            evaluate(e.self(), 1, false);
+            return *this;
+        }
 
-        bigint operator-() const;
+        bigint operator-() const&;
+        bigint operator-() &&;
 
         bigint& operator+=(const bigint& n);
         bigint& operator-=(const bigint& n);
         bigint& operator*=(const bigint& n);
         bigint& operator/=(const bigint& n);
         bigint& operator%=(const bigint& n);
+        template <class E>
+        bigint& operator+=(const expr<E>& e) {
+            evaluate(e.self(), 1, true);
+            return *this;
+        }
+        template <class E>
+        bigint& operator-=(const expr<E>& e) {
+            evaluate(e.self(), -1, true);
+            return *this;
+        }
+        template <class E>
+        bigint& operator*=(const expr<E>& e) {
+            return *this *= bigint(e);
+        }
+        // *this += a * b, *this -= a * b
+        bigint& addmul(const bigint& a, const bigint& b);
+        bigint& submul(const bigint& a, const bigint& b);
 
         bigint& operator++();
         bigint& operator++(int n);
         bigint& operator--();
         bigint& operator--(int n);
 
-        bigint operator+(const bigint& n) const;
-        bigint operator-(const bigint& n) const;
-        bigint operator*(const bigint& n) const;
-        bigint operator/(const bigint& n) const;
-        bigint operator%(const bigint& n) const;
-
-        bool operator>(const bigint& n) const;
-        bool operator<(const bigint& n) const;
-        bool operator>=(const bigint& n) const;
-        bool operator<=(const bigint& n) const;
-        bool operator==(const bigint& n) const;
-        bool operator!=(const bigint& n) const;
+        // a temporary left operand lends its storage to the quotient
+        friend bigint operator/(bigint a, const bigint& b);
+        friend bigint operator%(bigint a, const bigint& b);
+
+        friend bool operator>(const bigint& a, const bigint& b);
+        friend bool operator<(const bigint& a, const bigint& b);
+        friend bool operator>=(const bigint& a, const bigint& b);
+        friend bool operator<=(const bigint& a, const bigint& b);
+        friend bool operator==(const bigint& a, const bigint& b);
+        friend bool operator!=(const bigint& a, const bigint& b);
         bool operator!() const;
 
+        std::pair<bigint, bigint> divmod(const bigint& n) const;
         bigint abs() const;
-        std::string tostring(int str_len = 0) const;
+        std::string tostring(int str_len = 0, int base = 10) const;
         friend std::istream& operator>>(std::istream& in, bigint& n);
-        friend std::ostream& operator<<(std::ostream out, const bigint& n);
+        friend std::ostream& operator<<(std::ostream& out, const bigint& n);
+        friend bigint mod_exp(const bigint& a, const bigint& e, const bigint& m);
+
+    private:
+        // upper bound on the length of any term, in limbs
+        template <class T>
+        static std::size_t width(const operand<T>& x) { return x.v.value.size(); }
+        template <class A, class B>
+        static std::size_t width(const product<A, B>& e) { return width(e.a) + width(e.b); }
+        template <class A, class B, int S>
+        static std::size_t width(const sum<A, B, S>& e) { return std::max(width(e.a), width(e.b)); }
+        template <class A>
+        static std::size_t width(const negation<A>& e) { return width(e.a); }
+
+        // whether p is one of the operands
+        template <class T>
+        static bool refers(const operand<T>& x, const bigint* p) { return &x.v == p; }
+        template <class A, class B>
+        static bool refers(const product<A, B>& e, const bigint* p) { return refers(e.a, p) || refers(e.b, p); }
+        template <class A, class B, int S>
+        static bool refers(const sum<A, B, S>& e, const bigint* p) { return refers(e.a, p) || refers(e.b, p); }
+        template <class A>
+        static bool refers(const negation<A>& e, const bigint* p) { return refers(e.a, p); }
+
+        // acc[0..w) += s * e, the first term is written rather than added
+        template <class T>
+        static void accumulate(uint64* acc, std::size_t w, const operand<T>& x, int s, bool& first) {
+            acc_add(acc, w, x.v, s * x.v.sign, first);
+            first = false;
+        }
+        template <class A, class B>
+        static void accumulate(uint64* acc, std::size_t w, const product<A, B>& e, int s, bool& first) {
+            acc_addmul(acc, w, e.a.v, e.b.v, s * e.a.v.sign * e.b.v.sign, first);
+            first = false;
+        }
+        template <class A, class B, int S>
+        static void accumulate(uint64* acc, std::size_t w, const sum<A, B, S>& e, int s, bool& first) {
+            accumulate(acc, w, e.a, s, first);
+            accumulate(acc, w, e.b, s * S, first);
+        }
+        template <class A>
+        static void accumulate(uint64* acc, std::size_t w, const negation<A>& e, int s, bool& first) {
+            accumulate(acc, w, e.a, -s, first);
+        }
+
+        // *this = s * e, or *this += s * e if keep
+        template <class E>
+        void evaluate(const E& e, int s, bool keep) {
+            if (refers(e, this)) {
+                // the destination is also an operand
+                bigint t;
+                t.evaluate(e, s, false);
+                if (keep) {
+                    *this += t;
+                }
+                else {
+                    *this = std::move(t);
+                }
+                return;
+            }
+            // one guard limb holds the carries of all terms and the sign
+            const std::size_t w = std::max(width(e), keep ? value.size() : 0) + 1;
+            bool first = !keep;
+            if (keep) {
+                acc_start(w);
+            }
+            else {
+                value.resize(w);
+            }
+            accumulate(value.data(), w, e, s, first);
+            acc_finish();
+        }
+};
+
+/* Montgomery arithmetic modulo a fixed odd n > 1, R = base^k for a k limb n.
+ * A value a is held in Montgomery form as a*R mod n, products of such values
+ * are reduced without division: by CIOS for short moduli, by a full product
+ * and REDC for long ones. In constant time mode multiplication and pow()
+ * perform the same instructions and memory accesses for all operands below
+ * n, only the limb counts of the modulus and the exponent are revealed;
+ * to() still reduces its argument by ordinary division.
+ */
+class bigint::montgomery {
+    public:
+        explicit montgomery(const bigint& n, bool constant_time = false);
+
+        const bigint& modulus() const noexcept { return n; }
+        // a*R mod n for any a, and back
+        bigint to(const bigint& a) const;
+        bigint from(const bigint& a) const;
+        // a*b/R mod n for a, b in Montgomery form
+        bigint mul(const bigint& a, const bigint& b) const;
+        bigint sqr(const bigint& a) const;
+        // a^e mod n in ordinary form, e >= 0; sliding window, fixed window
+        // with table scans in constant time mode
+        bigint pow(const bigint& a, const bigint& e) const;
+
+    private:
+        void load(const bigint& a, uint64* r) const;
+        bigint store(const uint64* r) const;
+        void mul_limbs(uint64* r, const uint64* a, const uint64* b, uint64* t) const;
+
+        bigint n;
+        std::size_t k;
+        uint64 ninv;                // -n^-1 mod base
+        std::vector<uint64> r2;     // R^2 mod n
+        std::vector<uint64> one;    // R mod n
+        bool ct;
 };
+
+// a^e mod m for e >= 0, in [0, abs(m)); Montgomery exponentiation for odd m
+bigint mod_exp(const bigint& a, const bigint& e, const bigint& m);
+
+template <class A, class B, std::enable_if_t<bigint::are_args<A, B>, int> = 0>
+auto operator+(A&& a, B&& b) {
+    using TA = decltype(bigint::term(std::forward<A>(a)));
+    using TB = decltype(bigint::term(std::forward<B>(b)));
+    return bigint::sum<TA, TB, 1>(bigint::term(std::forward<A>(a)), bigint::term(std::forward<B>(b)));
+}
+
+template <class A, class B, std::enable_if_t<bigint::are_args<A, B>, int> = 0>
+auto operator-(A&& a, B&& b) {
+    using TA = decltype(bigint::term(std::forward<A>(a)));
+    using TB = decltype(bigint::term(std::forward<B>(b)));
+    return bigint::sum<TA, TB, -1>(bigint::term(std::forward<A>(a)), bigint::term(std::forward<B>(b)));
+}
+
+template <class A, class B, std::enable_if_t<bigint::are_args<A, B>, int> = 0>
+auto operator*(A&& a, B&& b) {
+    using FA = decltype(bigint::factor(std::forward<A>(a)));
+    using FB = decltype(bigint::factor(std::forward<B>(b)));
+    return bigint::product<FA, FB>(bigint::factor(std::forward<A>(a)), bigint::factor(std::forward<B>(b)));
+}
+
+template <class E, std::enable_if_t<bigint::is_expr<E>, int> = 0>
+auto operator-(E&& e) {
+    return bigint::negation<std::decay_t<E>>(std::forward<E>(e));
+}
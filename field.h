@@ -15,22 +15,64 @@ using i64 = std::int64_t;
 template <i64 Mod> class Field {
 // TODO rhs % mod == 0 -> no modinverse
 private:
-    i64 a;
+    // odd moduli are held in Montgomery form, a = x * 2^64 mod Mod, so a
+    // product costs one REDC instead of a 128-bit division
+    static constexpr bool mont_form = Mod & 1;
+    static constexpr Montgomery64 mont{static_cast<u64>(Mod)};
+
+    u64 a;
+
+    struct raw_tag {};
+    constexpr Field(const u64 m, raw_tag) noexcept : a(m) {}
+
+    static constexpr u64 norm(i64 n) noexcept {
+        n %= Mod;
+        return n < 0 ? n + Mod : n;
+    }
+
+    static constexpr u64 to(const u64 x) noexcept {
+        if constexpr (mont_form) return mont.to(x);
+        else return x;
+    }
+
+    static constexpr u64 from(const u64 x) noexcept {
+        if constexpr (mont_form) return mont.from(x);
+        else return x;
+    }
+
+    static constexpr u64 mul(const u64 x, const u64 y) noexcept {
+        if constexpr (mont_form) return mont.mul(x, y);
+        else return static_cast<u128>(x) * y % static_cast<u64>(Mod);
+    }
 
 public:
-    constexpr Field(const i64 n = 0) noexcept : a(n % Mod) {}
+    constexpr Field(const i64 n = 0) noexcept : a(to(norm(n))) {}
     constexpr Field(const Field& n) noexcept : a(n.a) {}
+    constexpr Field& operator=(const Field& rhs) noexcept = default;
+
+    static constexpr i64 mod() noexcept { return Mod; }
 
-    constexpr i64 value() const noexcept { return (a + Mod) % Mod; }
-    explicit constexpr operator i64() const noexcept { return a; }
-    explicit constexpr operator int() const noexcept { return a; }
+    // internal representation (Montgomery form for odd Mod), for array kernels
+    constexpr u64 raw() const noexcept { return a; }
+    static constexpr Field from_raw(const u64 m) noexcept { return Field(m, raw_tag{}); }
+
+    constexpr i64 value() const noexcept { return from(a); }
+    explicit constexpr operator i64() const noexcept { return value(); }
+    explicit constexpr operator int() const noexcept { return value(); }
     explicit constexpr operator bool() const noexcept { return a; }
 
-    constexpr Field pow(i64 exp) const noexcept { return Field(mod_exp(a, exp, Mod)); }
+    /* exp < 0 raises the inverse */
+    constexpr Field pow(i64 exp) const noexcept {
+        if (exp < 0) return inv().pow(-exp);
+        if constexpr (mont_form) return Field(window_pow(mont, a, exp), raw_tag{});
+        else return Field(mod_exp<i64>(a, exp, Mod));
+    }
+
+    constexpr Field inv() const noexcept { return Field(mod_inv<i64>(value(), Mod)); }
 
     constexpr Field& operator+=(const Field& rhs) noexcept {
         a += rhs.a;
-        if (a >= Mod) a -= Mod;
+        if (a >= static_cast<u64>(Mod)) a -= Mod;
         return *this;
     }
 
@@ -41,47 +83,23 @@ public:
     }
 
     constexpr Field& operator*=(const Field& rhs) noexcept {
-        a = mod_mult<i64>(a, rhs.a, Mod);
-        return *this;
-    }
-
-    constexpr Field& operator/=(const Field& rhs) noexcept {
-        *this *= mod_exp(rhs.a, Mod - 2, Mod);
-        return *this;
-    }
-
-    constexpr Field& operator+=(i64 rhs) noexcept {
-        if (Mod <= rhs || rhs < 0) rhs = ((rhs % Mod) + Mod) % Mod;
-        a += rhs;
-        if (a >= Mod) a -= Mod;
-        return *this;
-    }
-
-    constexpr Field& operator-=(i64 rhs) noexcept {
-        if (Mod <= rhs || rhs < 0) rhs = ((rhs % Mod) + Mod) % Mod;
-        if (a < rhs) a += Mod;
-        a -= rhs;
+        a = mul(a, rhs.a);
         return *this;
     }
 
-    constexpr Field& operator*=(i64 rhs) noexcept {
-        if (Mod <= rhs || rhs < 0) rhs = ((rhs % Mod) + Mod) % Mod;
-        a = mod_mult<i64>(a, rhs, Mod);
-        return *this;
-    }
+    constexpr Field& operator/=(const Field& rhs) noexcept { return *this *= rhs.inv(); }
 
-    constexpr Field& operator/=(i64 rhs) noexcept {
-        if (Mod <= rhs || rhs < 0) rhs = ((rhs % Mod) + Mod) % Mod;
-        *this *= mod_exp<i64>(rhs, Mod - 2, Mod);
-        return *this;
-    }
+    constexpr Field& operator+=(const i64 rhs) noexcept { return *this += Field(rhs); }
+    constexpr Field& operator-=(const i64 rhs) noexcept { return *this -= Field(rhs); }
+    constexpr Field& operator*=(const i64 rhs) noexcept { return *this *= Field(rhs); }
+    constexpr Field& operator/=(const i64 rhs) noexcept { return *this /= Field(rhs); }
 
     constexpr Field operator+(const Field& rhs) const noexcept { return Field(*this) += rhs; }
     constexpr Field operator-(const Field& rhs) const noexcept { return Field(*this) -= rhs; }
     constexpr Field operator*(const Field& rhs) const noexcept { return Field(*this) *= rhs; }
     constexpr Field operator/(const Field& rhs) const noexcept { return Field(*this) /= rhs; }
 
-    constexpr Field operator-() const noexcept { return Field(Mod - a); }
+    constexpr Field operator-() const noexcept { return Field(a ? Mod - a : 0, raw_tag{}); }
     constexpr bool operator==(const Field& rhs) const noexcept { return a == rhs.a; }
     constexpr bool operator!=(const Field& rhs) const noexcept { return a != rhs.a; }
 
@@ -107,5 +125,145 @@ std::ostream& operator<<(std::ostream& out, const Field<Mod>& f) {
 
 template <i64 Mod>
 Field<Mod> pow(const Field<Mod>& base, i64 exp) {
-    return Field<Mod>(mod_exp(base, exp, Mod));
+    return base.pow(exp);
+}
+
+/* Field whose modulus is only known at runtime
+ * Works like Field<Mod>, with the modulus and its Montgomery or Barrett
+ * constants held in a thread-local context per Id. Set it with
+ * DynField<Id>::set_mod, or for a block of code with a
+ * DynField<Id>::scoped_mod, which restores the previous modulus on exit.
+ * Each thread has its own modulus, so values must stay in the thread (and
+ * the scope) they were created in. Distinct Ids give independent moduli.
+ * 1 <= mod < 2^63
+ * */
+
+class FieldContext {
+private:
+    u64 n;
+    bool mont_form;
+    Montgomery64 mont;
+    Barrett64 bar;
+
+public:
+    constexpr explicit FieldContext(const i64 mod = 1) noexcept
+        : n(mod), mont_form(mod & 1), mont(mod | 1), bar(mod) {}
+
+    i64 mod() const noexcept { return n; }
+
+    u64 norm(i64 x) const noexcept {
+        x %= static_cast<i64>(n);
+        return x < 0 ? x + n : x;
+    }
+
+    u64 to(const u64 x) const noexcept { return mont_form ? mont.to(x) : x; }
+    u64 from(const u64 x) const noexcept { return mont_form ? mont.from(x) : x; }
+    u64 mul(const u64 x, const u64 y) const noexcept { return mont_form ? mont.mul(x, y) : bar.mul(x, y); }
+
+    u64 pow(const u64 x, const u64 e) const noexcept { return mont_form ? mont.pow(x, e) : bar.pow(x, e); }
+};
+
+template <int Id = 0> class DynField {
+private:
+    // constant initialised, so access needs no thread-local guard
+    static inline thread_local FieldContext ctx;
+
+    u64 a;
+
+    struct raw_tag {};
+    DynField(const u64 m, raw_tag) noexcept : a(m) {}
+
+public:
+    static void set_mod(const i64 mod) noexcept { ctx = FieldContext(mod); }
+
+    /* Sets the modulus of this thread until the end of the scope */
+    class scoped_mod {
+    private:
+        FieldContext saved;
+
+    public:
+        explicit scoped_mod(const i64 mod) noexcept : saved(ctx) { set_mod(mod); }
+        ~scoped_mod() { ctx = saved; }
+
+        scoped_mod(const scoped_mod&) = delete;
+        scoped_mod& operator=(const scoped_mod&) = delete;
+    };
+
+    static const FieldContext& context() noexcept { return ctx; }
+    static i64 mod() noexcept { return ctx.mod(); }
+
+    u64 raw() const noexcept { return a; }
+    static DynField from_raw(const u64 m) noexcept { return DynField(m, raw_tag{}); }
+
+    DynField(const i64 n = 0) noexcept : a(ctx.to(ctx.norm(n))) {}
+
+    i64 value() const noexcept { return ctx.from(a); }
+    explicit operator i64() const noexcept { return value(); }
+    explicit operator int() const noexcept { return value(); }
+    explicit operator bool() const noexcept { return a; }
+
+    /* exp < 0 raises the inverse */
+    DynField pow(i64 exp) const noexcept {
+        if (exp < 0) return inv().pow(-exp);
+        return DynField(ctx.pow(a, exp), raw_tag{});
+    }
+
+    DynField inv() const noexcept { return DynField(mod_inv<i64>(value(), mod())); }
+
+    DynField& operator+=(const DynField& rhs) noexcept {
+        a += rhs.a;
+        if (a >= static_cast<u64>(mod())) a -= mod();
+        return *this;
+    }
+
+    DynField& operator-=(const DynField& rhs) noexcept {
+        if (a < rhs.a) a += mod();
+        a -= rhs.a;
+        return *this;
+    }
+
+    DynField& operator*=(const DynField& rhs) noexcept {
+        a = ctx.mul(a, rhs.a);
+        return *this;
+    }
+
+    DynField& operator/=(const DynField& rhs) noexcept { return *this *= rhs.inv(); }
+
+    DynField& operator+=(const i64 rhs) noexcept { return *this += DynField(rhs); }
+    DynField& operator-=(const i64 rhs) noexcept { return *this -= DynField(rhs); }
+    DynField& operator*=(const i64 rhs) noexcept { return *this *= DynField(rhs); }
+    DynField& operator/=(const i64 rhs) noexcept { return *this /= DynField(rhs); }
+
+    DynField operator+(const DynField& rhs) const noexcept { return DynField(*this) += rhs; }
+    DynField operator-(const DynField& rhs) const noexcept { return DynField(*this) -= rhs; }
+    DynField operator*(const DynField& rhs) const noexcept { return DynField(*this) *= rhs; }
+    DynField operator/(const DynField& rhs) const noexcept { return DynField(*this) /= rhs; }
+
+    DynField operator-() const noexcept { return DynField(a ? mod() - a : 0, raw_tag{}); }
+    bool operator==(const DynField& rhs) const noexcept { return a == rhs.a; }
+    bool operator!=(const DynField& rhs) const noexcept { return a != rhs.a; }
+
+    DynField operator+(const i64 rhs) const noexcept { return DynField(*this) += rhs; }
+    DynField operator-(const i64 rhs) const noexcept { return DynField(*this) -= rhs; }
+    DynField operator*(const i64 rhs) const noexcept { return DynField(*this) *= rhs; }
+    DynField operator/(const i64 rhs) const noexcept { return DynField(*this) /= rhs; }
+};
+
+template <int Id>
+std::istream& operator>>(std::istream& in, DynField<Id>& f) {
+    i64 x;
+    in >> x;
+    f = DynField<Id>(x);
+    return in;
+}
+
+template <int Id>
+std::ostream& operator<<(std::ostream& out, const DynField<Id>& f) {
+    out << f.value();
+    return out;
+}
+
+template <int Id>
+DynField<Id> pow(const DynField<Id>& base, i64 exp) {
+    return base.pow(exp);
 }
@@ -0,0 +1,462 @@
+#pragma once
+#include "field.h"
+#include "mod_batch.h"
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/* Array kernels over Field<Mod>
+ * Element-wise r = a + b, a - b, a * b, a * c, y += c * x, the dot product,
+ * batch inversion and the two NTT butterflies, on n consecutive elements
+ * (r may alias a or b). Odd moduli run on the raw Montgomery values with
+ * the kernels picked as in mod_batch.h: AVX-512 IFMA for Mod < 2^52, AVX2
+ * for Mod < 2^32, scalar otherwise. Even moduli use the Field operators.
+ * */
+
+template <i64 Mod>
+using FieldVector = std::vector<Field<Mod>>;
+
+template <i64 Mod>
+void fv_add(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, std::size_t n);
+
+template <i64 Mod>
+void fv_sub(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, std::size_t n);
+
+template <i64 Mod>
+void fv_mul(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, std::size_t n);
+
+template <i64 Mod>
+void fv_scale(Field<Mod>* r, const Field<Mod>* a, Field<Mod> c, std::size_t n);
+
+template <i64 Mod>
+void fv_axpy(Field<Mod>* y, Field<Mod> c, const Field<Mod>* x, std::size_t n);
+
+template <i64 Mod>
+Field<Mod> fv_dot(const Field<Mod>* a, const Field<Mod>* b, std::size_t n);
+
+template <i64 Mod>
+void fv_inv(Field<Mod>* r, const Field<Mod>* a, std::size_t n);
+
+template <i64 Mod>
+void fv_dif(Field<Mod>* u, Field<Mod>* v, const Field<Mod>* w, std::size_t n);
+
+template <i64 Mod>
+void fv_dit(Field<Mod>* u, Field<Mod>* v, const Field<Mod>* w, std::size_t n);
+
+namespace fv_detail {
+
+using mod_batch_detail::isa;
+
+/* Constants of one odd modulus for the raw kernels. Values are in
+ * Montgomery form for R = 2^64, while the SIMD products reduce by 2^shift:
+ * one such product of two Field values is off by 2^(64 - shift), which a
+ * second product with k undoes. A constant multiplier is instead stored
+ * as c * 2^shift, which needs a single product.
+ */
+struct context {
+    isa kind;
+    u64 n, ninv, k;
+    int shift;
+    Montgomery64 mont;
+
+    explicit context(const u64 mod) : kind(mod_batch_detail::select(mod)), n(mod), ninv(0), k(1),
+                                      shift(kind == isa::ifma ? 52 : 32), mont(mod) {
+        if (kind == isa::scalar) return;
+        ninv = mod_batch_detail::mont_consts(mod, shift).ninv;
+        if (kind == isa::ifma) k = (u64(1) << 40) % mod;
+    }
+
+    u64 multiplier(const u64 c) const noexcept { return mont.redc(static_cast<u128>(c) << shift); }
+
+    u64 add(const u64 a, const u64 b) const noexcept {
+        const u64 s = a + b;
+        return s < s - n ? s : s - n;
+    }
+
+    u64 sub(const u64 a, const u64 b) const noexcept {
+        const u64 d = a - b;
+        return d < d + n ? d : d + n;
+    }
+};
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx512f")))
+inline __m512i add_512(const __m512i a, const __m512i b, const __m512i n) {
+    const __m512i s = _mm512_add_epi64(a, b);
+    return _mm512_mask_sub_epi64(s, _mm512_cmpge_epu64_mask(s, n), s, n);
+}
+
+__attribute__((target("avx512f")))
+inline __m512i sub_512(const __m512i a, const __m512i b, const __m512i n) {
+    const __m512i d = _mm512_sub_epi64(a, b);
+    return _mm512_mask_add_epi64(d, _mm512_cmplt_epu64_mask(a, b), d, n);
+}
+
+// product of two Field values
+__attribute__((target("avx512f,avx512ifma")))
+inline __m512i mul_512(const __m512i a, const __m512i b, const __m512i n, const __m512i ninv, const __m512i k) {
+    return mod_batch_detail::mul_ifma(mod_batch_detail::mul_ifma(a, b, n, ninv), k, n, ninv);
+}
+
+// values below 2^32, so the signed compares are exact
+__attribute__((target("avx2")))
+inline __m256i add_256(const __m256i a, const __m256i b, const __m256i n1, const __m256i n) {
+    const __m256i s = _mm256_add_epi64(a, b);
+    return _mm256_sub_epi64(s, _mm256_and_si256(_mm256_cmpgt_epi64(s, n1), n));
+}
+
+__attribute__((target("avx2")))
+inline __m256i sub_256(const __m256i a, const __m256i b, const __m256i n) {
+    const __m256i d = _mm256_sub_epi64(a, b);
+    return _mm256_add_epi64(d, _mm256_and_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), d), n));
+}
+
+// k == 1 for R = 2^32, so the second product is a plain reduction
+__attribute__((target("avx2")))
+inline __m256i mul_256(const __m256i a, const __m256i b, const __m256i n, const __m256i ninv) {
+    return mod_batch_detail::mul_avx2(mod_batch_detail::mul_avx2(a, b, n, ninv), _mm256_set1_epi64x(1), n, ninv);
+}
+
+__attribute__((target("avx512f")))
+inline __m512i load_512(const u64* p) { return _mm512_loadu_si512(p); }
+
+__attribute__((target("avx512f")))
+inline void store_512(u64* p, const __m512i x) { _mm512_storeu_si512(p, x); }
+
+__attribute__((target("avx2")))
+inline __m256i load_256(const u64* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+
+__attribute__((target("avx2")))
+inline void store_256(u64* p, const __m256i x) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x); }
+
+/* op: 0 add, 1 sub, 2 mul, 3 scale by c2, 4 axpy r += c2 * b */
+__attribute__((target("avx512f,avx512ifma")))
+inline std::size_t binary_512(const context& c, const int op, u64* r, const u64* a, const u64* b,
+                              const u64 c2, const std::size_t cnt) {
+    const __m512i n = _mm512_set1_epi64(c.n), ninv = _mm512_set1_epi64(c.ninv), k = _mm512_set1_epi64(c.k);
+    const __m512i m = _mm512_set1_epi64(c2);
+    std::size_t i = 0;
+    for (; i + 8 <= cnt; i += 8) {
+        const __m512i x = load_512(a + i);
+        __m512i y;
+        switch (op) {
+            case 0: y = add_512(x, load_512(b + i), n); break;
+            case 1: y = sub_512(x, load_512(b + i), n); break;
+            case 2: y = mul_512(x, load_512(b + i), n, ninv, k); break;
+            case 3: y = mod_batch_detail::mul_ifma(x, m, n, ninv); break;
+            default: y = add_512(load_512(r + i), mod_batch_detail::mul_ifma(load_512(b + i), m, n, ninv), n);
+        }
+        store_512(r + i, y);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t binary_256(const context& c, const int op, u64* r, const u64* a, const u64* b,
+                              const u64 c2, const std::size_t cnt) {
+    const __m256i n = _mm256_set1_epi64x(c.n), n1 = _mm256_set1_epi64x(c.n - 1), ninv = _mm256_set1_epi64x(c.ninv);
+    const __m256i m = _mm256_set1_epi64x(c2);
+    std::size_t i = 0;
+    for (; i + 4 <= cnt; i += 4) {
+        const __m256i x = load_256(a + i);
+        __m256i y;
+        switch (op) {
+            case 0: y = add_256(x, load_256(b + i), n1, n); break;
+            case 1: y = sub_256(x, load_256(b + i), n); break;
+            case 2: y = mul_256(x, load_256(b + i), n, ninv); break;
+            case 3: y = mod_batch_detail::mul_avx2(x, m, n, ninv); break;
+            default: y = add_256(load_256(r + i), mod_batch_detail::mul_avx2(load_256(b + i), m, n, ninv), n1, n);
+        }
+        store_256(r + i, y);
+    }
+    return i;
+}
+
+/* dif: u, v = u + v, (u - v) w; dit: u, v = u + v w, u - v w */
+__attribute__((target("avx512f,avx512ifma")))
+inline std::size_t butterfly_512(const context& c, const bool dif, u64* u, u64* v, const u64* w, const std::size_t cnt) {
+    const __m512i n = _mm512_set1_epi64(c.n), ninv = _mm512_set1_epi64(c.ninv), k = _mm512_set1_epi64(c.k);
+    std::size_t i = 0;
+    for (; i + 8 <= cnt; i += 8) {
+        const __m512i x = load_512(u + i), y = load_512(v + i), z = load_512(w + i);
+        if (dif) {
+            store_512(u + i, add_512(x, y, n));
+            store_512(v + i, mul_512(sub_512(x, y, n), z, n, ninv, k));
+        }
+        else {
+            const __m512i t = mul_512(y, z, n, ninv, k);
+            store_512(u + i, add_512(x, t, n));
+            store_512(v + i, sub_512(x, t, n));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t butterfly_256(const context& c, const bool dif, u64* u, u64* v, const u64* w, const std::size_t cnt) {
+    const __m256i n = _mm256_set1_epi64x(c.n), n1 = _mm256_set1_epi64x(c.n - 1), ninv = _mm256_set1_epi64x(c.ninv);
+    std::size_t i = 0;
+    for (; i + 4 <= cnt; i += 4) {
+        const __m256i x = load_256(u + i), y = load_256(v + i), z = load_256(w + i);
+        if (dif) {
+            store_256(u + i, add_256(x, y, n1, n));
+            store_256(v + i, mul_256(sub_256(x, y, n), z, n, ninv));
+        }
+        else {
+            const __m256i t = mul_256(y, z, n, ninv);
+            store_256(u + i, add_256(x, t, n1, n));
+            store_256(v + i, sub_256(x, t, n));
+        }
+    }
+    return i;
+}
+
+/* dot product sum a_i b_i as a 128-bit value reduced mod n; products are
+ * split into low and high halves summed per lane, folded before they can
+ * overflow
+ */
+__attribute__((target("avx512f,avx512ifma")))
+inline u128 dot_512(const context& c, const u64* a, const u64* b, const std::size_t cnt, std::size_t& done) {
+    u128 total = 0;
+    std::size_t i = 0;
+    alignas(64) u64 lo[8], hi[8];
+    while (i + 8 <= cnt) {
+        __m512i acc_lo = _mm512_setzero_si512(), acc_hi = _mm512_setzero_si512();
+        // 2^12 terms below 2^52 fit a 64-bit lane
+        const std::size_t end = std::min(cnt - cnt % 8, i + 8 * 4096);
+        for (; i < end; i += 8) {
+            const __m512i x = load_512(a + i), y = load_512(b + i);
+            acc_lo = _mm512_madd52lo_epu64(acc_lo, x, y);
+            acc_hi = _mm512_madd52hi_epu64(acc_hi, x, y);
+        }
+        _mm512_store_si512(lo, acc_lo);
+        _mm512_store_si512(hi, acc_hi);
+        for (int l = 0; l < 8; ++l) total += (static_cast<u128>(hi[l]) << 52) + lo[l];
+        total %= c.n;
+    }
+    done = i;
+    return total;
+}
+
+__attribute__((target("avx2")))
+inline u128 dot_256(const context& c, const u64* a, const u64* b, const std::size_t cnt, std::size_t& done) {
+    const __m256i mask = _mm256_set1_epi64x(0xffffffff);
+    u128 total = 0;
+    std::size_t i = 0;
+    alignas(32) u64 lo[4], hi[4];
+    while (i + 4 <= cnt) {
+        __m256i acc_lo = _mm256_setzero_si256(), acc_hi = _mm256_setzero_si256();
+        const std::size_t end = std::min(cnt - cnt % 4, i + (std::size_t(4) << 30));
+        for (; i < end; i += 4) {
+            const __m256i p = _mm256_mul_epu32(load_256(a + i), load_256(b + i));
+            acc_lo = _mm256_add_epi64(acc_lo, _mm256_and_si256(p, mask));
+            acc_hi = _mm256_add_epi64(acc_hi, _mm256_srli_epi64(p, 32));
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lo), acc_lo);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(hi), acc_hi);
+        for (int l = 0; l < 4; ++l) total += (static_cast<u128>(hi[l]) << 32) + lo[l];
+        total %= c.n;
+    }
+    done = i;
+    return total;
+}
+
+#endif
+
+/* raw kernels with the scalar tail, c2 = multiplier(cm) */
+inline void binary(const context& c, const int op, u64* r, const u64* a, const u64* b,
+                   const u64 cm, const std::size_t cnt) {
+    std::size_t i = 0;
+#if defined(__x86_64__)
+    if (c.kind == isa::ifma) i = binary_512(c, op, r, a, b, op >= 3 ? c.multiplier(cm) : 0, cnt);
+    else if (c.kind == isa::avx2) i = binary_256(c, op, r, a, b, op >= 3 ? c.multiplier(cm) : 0, cnt);
+#endif
+    for (; i < cnt; ++i) {
+        switch (op) {
+            case 0: r[i] = c.add(a[i], b[i]); break;
+            case 1: r[i] = c.sub(a[i], b[i]); break;
+            case 2: r[i] = c.mont.mul(a[i], b[i]); break;
+            case 3: r[i] = c.mont.mul(a[i], cm); break;
+            default: r[i] = c.add(r[i], c.mont.mul(b[i], cm));
+        }
+    }
+}
+
+inline void butterfly(const context& c, const bool dif, u64* u, u64* v, const u64* w, const std::size_t cnt) {
+    std::size_t i = 0;
+#if defined(__x86_64__)
+    if (c.kind == isa::ifma) i = butterfly_512(c, dif, u, v, w, cnt);
+    else if (c.kind == isa::avx2) i = butterfly_256(c, dif, u, v, w, cnt);
+#endif
+    for (; i < cnt; ++i) {
+        if (dif) {
+            const u64 x = u[i], y = v[i];
+            u[i] = c.add(x, y);
+            v[i] = c.mont.mul(c.sub(x, y), w[i]);
+        }
+        else {
+            const u64 x = u[i], t = c.mont.mul(v[i], w[i]);
+            u[i] = c.add(x, t);
+            v[i] = c.sub(x, t);
+        }
+    }
+}
+
+/* sum a_i b_i, returned in Montgomery form */
+inline u64 dot(const context& c, const u64* a, const u64* b, const std::size_t cnt) {
+    std::size_t i = 0;
+    u128 total = 0;
+#if defined(__x86_64__)
+    if (c.kind == isa::ifma) total = dot_512(c, a, b, cnt, i);
+    else if (c.kind == isa::avx2) total = dot_256(c, a, b, cnt, i);
+#endif
+    // lazy reduction: keep the high half below n, which leaves the value
+    // unchanged after REDC
+    const u128 top = static_cast<u128>(c.n) << 64;
+    for (; i < cnt; ++i) {
+        total += static_cast<u128>(a[i]) * b[i];
+        if (total >= top) total -= top;
+    }
+    // sum of products of two R-scaled values carries R^2, REDC leaves R
+    return c.mont.redc(total);
+}
+
+template <i64 Mod>
+const context& get() {
+    static const context c(Mod);
+    return c;
+}
+
+template <i64 Mod>
+u64* raw(Field<Mod>* p) {
+    static_assert(sizeof(Field<Mod>) == sizeof(u64) && std::is_standard_layout_v<Field<Mod>>);
+    return reinterpret_cast<u64*>(p);
+}
+
+template <i64 Mod>
+const u64* raw(const Field<Mod>* p) {
+    static_assert(sizeof(Field<Mod>) == sizeof(u64) && std::is_standard_layout_v<Field<Mod>>);
+    return reinterpret_cast<const u64*>(p);
+}
+
+} // namespace fv_detail
+
+template <i64 Mod>
+void fv_add(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::binary(fv_detail::get<Mod>(), 0, fv_detail::raw(r), fv_detail::raw(a), fv_detail::raw(b), 0, n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) r[i] = a[i] + b[i];
+    }
+}
+
+template <i64 Mod>
+void fv_sub(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::binary(fv_detail::get<Mod>(), 1, fv_detail::raw(r), fv_detail::raw(a), fv_detail::raw(b), 0, n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) r[i] = a[i] - b[i];
+    }
+}
+
+template <i64 Mod>
+void fv_mul(Field<Mod>* r, const Field<Mod>* a, const Field<Mod>* b, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::binary(fv_detail::get<Mod>(), 2, fv_detail::raw(r), fv_detail::raw(a), fv_detail::raw(b), 0, n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) r[i] = a[i] * b[i];
+    }
+}
+
+template <i64 Mod>
+void fv_scale(Field<Mod>* r, const Field<Mod>* a, const Field<Mod> c, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::binary(fv_detail::get<Mod>(), 3, fv_detail::raw(r), fv_detail::raw(a), nullptr, c.raw(), n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) r[i] = a[i] * c;
+    }
+}
+
+/* y += c * x */
+template <i64 Mod>
+void fv_axpy(Field<Mod>* y, const Field<Mod> c, const Field<Mod>* x, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::binary(fv_detail::get<Mod>(), 4, fv_detail::raw(y), fv_detail::raw(y), fv_detail::raw(x), c.raw(), n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) y[i] += c * x[i];
+    }
+}
+
+/* Dot product, reduced once at the end */
+template <i64 Mod>
+Field<Mod> fv_dot(const Field<Mod>* a, const Field<Mod>* b, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        return Field<Mod>::from_raw(fv_detail::dot(fv_detail::get<Mod>(), fv_detail::raw(a), fv_detail::raw(b), n));
+    }
+    else {
+        Field<Mod> s = 0;
+        for (std::size_t i = 0; i < n; ++i) s += a[i] * b[i];
+        return s;
+    }
+}
+
+/* Batch inversion, r_i = 1 / a_i
+ * Montgomery's trick: prefix products, one inversion of the total, then
+ * a backward sweep, 3(n - 1) multiplications in all. Zeros are passed over
+ * and stay zero. r may alias a.
+ */
+template <i64 Mod>
+void fv_inv(Field<Mod>* r, const Field<Mod>* a, const std::size_t n) {
+    std::vector<Field<Mod>> prefix(n);
+    Field<Mod> acc = 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        prefix[i] = acc;
+        if (a[i]) acc *= a[i];
+    }
+    acc = acc.inv();
+    for (std::size_t i = n; i-- > 0;) {
+        if (!a[i]) {
+            r[i] = 0;
+            continue;
+        }
+        const Field<Mod> x = a[i];
+        r[i] = acc * prefix[i];
+        acc *= x;
+    }
+}
+
+/* Decimation-in-frequency butterflies, u_i, v_i = u_i + v_i, (u_i - v_i) w_i */
+template <i64 Mod>
+void fv_dif(Field<Mod>* u, Field<Mod>* v, const Field<Mod>* w, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::butterfly(fv_detail::get<Mod>(), true, fv_detail::raw(u), fv_detail::raw(v), fv_detail::raw(w), n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) {
+            const Field<Mod> x = u[i], y = v[i];
+            u[i] = x + y;
+            v[i] = (x - y) * w[i];
+        }
+    }
+}
+
+/* Decimation-in-time butterflies, u_i, v_i = u_i + v_i w_i, u_i - v_i w_i */
+template <i64 Mod>
+void fv_dit(Field<Mod>* u, Field<Mod>* v, const Field<Mod>* w, const std::size_t n) {
+    if constexpr (Mod & 1) {
+        fv_detail::butterfly(fv_detail::get<Mod>(), false, fv_detail::raw(u), fv_detail::raw(v), fv_detail::raw(w), n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) {
+            const Field<Mod> x = u[i], t = v[i] * w[i];
+            u[i] = x + t;
+            v[i] = x - t;
+        }
+    }
+}
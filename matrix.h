@@ -0,0 +1,322 @@
+#pragma once
+#include "field.h"
+#include "field_vector.h"
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/* Dense matrices over a field
+ * T is Field<Mod>, DynField<Id> or any type with the field operators.
+ * Matrix<Field<Mod>> with odd Mod multiplies on the raw Montgomery values,
+ * summing whole 128-bit products and reducing once per entry (see
+ * matrix_detail), and runs row operations through field_vector.h.
+ * */
+
+template <typename T>
+class Matrix;
+
+namespace matrix_detail {
+
+template <typename T>
+struct field_modulus : std::integral_constant<i64, 0> {};
+
+template <i64 Mod>
+struct field_modulus<Field<Mod>> : std::integral_constant<i64, Mod> {};
+
+// T is a Field<Mod> with the raw kernels
+template <typename T>
+constexpr bool raw_field = field_modulus<T>::value & 1;
+
+// tiles of C (rows x columns) and the depth of A and B summed per pass
+constexpr std::size_t row_block = 32, col_block = 256, depth_block = 256;
+
+/* acc mod n * 2^64, the value REDC sees unchanged */
+inline void fold(u128& acc, const u64 n) {
+    acc = (static_cast<u128>(static_cast<u64>(acc >> 64) % n) << 64) | static_cast<u64>(acc);
+}
+
+#if defined(__x86_64__)
+
+/* acc[j] += sum over kk of a[kk] * b[kk][j] for j < 8 * vecs, exactly.
+ * 52-bit products split into low and high halves summed per lane; depth
+ * below 2^12 keeps the 64-bit lanes from overflowing.
+ */
+__attribute__((target("avx512f,avx512ifma")))
+inline void row_ifma(u128* acc, const u64* a, const u64* b, const std::size_t ldb,
+                     const std::size_t depth, const std::size_t vecs) {
+    alignas(64) u64 lo[8], hi[8];
+    for (std::size_t v = 0; v < vecs; ++v) {
+        __m512i acc_lo = _mm512_setzero_si512(), acc_hi = _mm512_setzero_si512();
+        for (std::size_t kk = 0; kk < depth; ++kk) {
+            const __m512i x = _mm512_set1_epi64(a[kk]), y = _mm512_loadu_si512(b + kk * ldb + 8 * v);
+            acc_lo = _mm512_madd52lo_epu64(acc_lo, x, y);
+            acc_hi = _mm512_madd52hi_epu64(acc_hi, x, y);
+        }
+        _mm512_store_si512(lo, acc_lo);
+        _mm512_store_si512(hi, acc_hi);
+        for (int l = 0; l < 8; ++l) acc[8 * v + l] += (static_cast<u128>(hi[l]) << 52) + lo[l];
+    }
+}
+
+#endif
+
+/* C rows [r0, r1) = A B on raw Montgomery values, A is n x k, B is k x m.
+ * Entries sum unreduced 128-bit products. Each product is below (n - 1)^2,
+ * so a pass of up to `safe` of them fits on top of an accumulator folded
+ * below n * 2^64; one REDC per entry then gives the Montgomery form of
+ * the sum, as the products carry R^2.
+ */
+inline void mul_rows(const fv_detail::context& c, const u64* A, const u64* B, u64* C,
+                     const std::size_t k, const std::size_t m, const std::size_t r0, const std::size_t r1) {
+    const u64 n = c.n;
+    const u128 room = ~u128(0) - (static_cast<u128>(n) << 64), sq = static_cast<u128>(n - 1) * (n - 1);
+    const std::size_t safe = sq && room / sq < depth_block ? static_cast<std::size_t>(room / sq) : depth_block;
+#if defined(__x86_64__)
+    const bool ifma = c.kind == fv_detail::isa::ifma;
+#else
+    const bool ifma = false;
+#endif
+    std::vector<u128> acc(row_block * col_block);
+    for (std::size_t i0 = r0; i0 < r1; i0 += row_block) {
+        const std::size_t i1 = std::min(i0 + row_block, r1);
+        for (std::size_t j0 = 0; j0 < m; j0 += col_block) {
+            const std::size_t w = std::min(col_block, m - j0), vecs = ifma ? w / 8 : 0;
+            std::fill(acc.begin(), acc.end(), u128(0));
+            for (std::size_t k0 = 0; k0 < k; k0 += safe) {
+                const std::size_t depth = std::min(safe, k - k0);
+                for (std::size_t i = i0; i < i1; ++i) {
+                    u128* row = &acc[(i - i0) * col_block];
+                    const u64* ai = A + i * k + k0;
+                    const u64* b = B + k0 * m + j0;
+#if defined(__x86_64__)
+                    if (vecs) row_ifma(row, ai, b, m, depth, vecs);
+#endif
+                    for (std::size_t kk = 0; kk < depth; ++kk) {
+                        const u64 x = ai[kk];
+                        if (!x) continue;
+                        const u64* bk = b + kk * m;
+                        for (std::size_t j = 8 * vecs; j < w; ++j) row[j] += static_cast<u128>(x) * bk[j];
+                    }
+                    for (std::size_t j = 0; j < w; ++j) fold(row[j], n);
+                }
+            }
+            for (std::size_t i = i0; i < i1; ++i) {
+                const u128* row = &acc[(i - i0) * col_block];
+                for (std::size_t j = 0; j < w; ++j) C[i * m + j0 + j] = c.mont.redc(row[j]);
+            }
+        }
+    }
+}
+
+/* y += c x on row segments */
+template <typename T>
+void axpy(T* y, const T c, const T* x, const std::size_t n) {
+    if constexpr (raw_field<T>) {
+        fv_axpy(y, c, x, n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) y[i] += c * x[i];
+    }
+}
+
+template <typename T>
+void scale(T* x, const T c, const std::size_t n) {
+    if constexpr (raw_field<T>) {
+        fv_scale(x, x, c, n);
+    }
+    else {
+        for (std::size_t i = 0; i < n; ++i) x[i] *= c;
+    }
+}
+
+} // namespace matrix_detail
+
+template <typename T>
+class Matrix {
+private:
+    std::size_t n, m;
+    std::vector<T> a;  // row-major
+
+public:
+    // threads a single multiplication may use, 1 keeps it serial
+    static inline unsigned threads = 1;
+
+    Matrix(const std::size_t rows = 0, const std::size_t cols = 0, const T& fill = T(0))
+        : n(rows), m(cols), a(rows * cols, fill) {}
+
+    Matrix(const std::initializer_list<std::initializer_list<T>> rows) : n(rows.size()), m(0) {
+        if (n) m = rows.begin()->size();
+        a.reserve(n * m);
+        for (const auto& r: rows) {
+            if (r.size() != m) throw std::invalid_argument("Matrix: rows of different lengths");
+            a.insert(a.end(), r.begin(), r.end());
+        }
+    }
+
+    static Matrix identity(const std::size_t size) {
+        Matrix r(size, size);
+        for (std::size_t i = 0; i < size; ++i) r(i, i) = T(1);
+        return r;
+    }
+
+    std::size_t rows() const noexcept { return n; }
+    std::size_t cols() const noexcept { return m; }
+
+    T& operator()(const std::size_t i, const std::size_t j) noexcept { return a[i * m + j]; }
+    const T& operator()(const std::size_t i, const std::size_t j) const noexcept { return a[i * m + j]; }
+    T* operator[](const std::size_t i) noexcept { return a.data() + i * m; }
+    const T* operator[](const std::size_t i) const noexcept { return a.data() + i * m; }
+
+    bool operator==(const Matrix& rhs) const { return n == rhs.n && m == rhs.m && a == rhs.a; }
+    bool operator!=(const Matrix& rhs) const { return !(*this == rhs); }
+
+    Matrix& operator+=(const Matrix& rhs) {
+        if (n != rhs.n || m != rhs.m) throw std::invalid_argument("Matrix: dimension mismatch");
+        if constexpr (matrix_detail::raw_field<T>) fv_add(a.data(), a.data(), rhs.a.data(), a.size());
+        else for (std::size_t i = 0; i < a.size(); ++i) a[i] += rhs.a[i];
+        return *this;
+    }
+
+    Matrix& operator-=(const Matrix& rhs) {
+        if (n != rhs.n || m != rhs.m) throw std::invalid_argument("Matrix: dimension mismatch");
+        if constexpr (matrix_detail::raw_field<T>) fv_sub(a.data(), a.data(), rhs.a.data(), a.size());
+        else for (std::size_t i = 0; i < a.size(); ++i) a[i] -= rhs.a[i];
+        return *this;
+    }
+
+    Matrix& operator*=(const T& c) {
+        matrix_detail::scale(a.data(), c, a.size());
+        return *this;
+    }
+
+    Matrix& operator*=(const Matrix& rhs) { return *this = *this * rhs; }
+
+    Matrix operator+(const Matrix& rhs) const { return Matrix(*this) += rhs; }
+    Matrix operator-(const Matrix& rhs) const { return Matrix(*this) -= rhs; }
+    Matrix operator*(const T& c) const { return Matrix(*this) *= c; }
+
+    /* Matrix product
+     * Row blocks are split between threads; Field<Mod> with odd Mod sums
+     * raw 128-bit products and reduces each entry once.
+     */
+    Matrix operator*(const Matrix& rhs) const {
+        if (m != rhs.n) throw std::invalid_argument("Matrix: dimension mismatch");
+        Matrix r(n, rhs.m);
+        const std::size_t k = m, cols = rhs.m;
+        const auto run = [&](const std::size_t r0, const std::size_t r1) {
+            if constexpr (matrix_detail::raw_field<T>) {
+                constexpr i64 Mod = matrix_detail::field_modulus<T>::value;
+                matrix_detail::mul_rows(fv_detail::get<Mod>(), fv_detail::raw(a.data()), fv_detail::raw(rhs.a.data()),
+                                        fv_detail::raw(r.a.data()), k, cols, r0, r1);
+            }
+            else {
+                for (std::size_t i = r0; i < r1; ++i) {
+                    for (std::size_t kk = 0; kk < k; ++kk) {
+                        const T x = (*this)(i, kk);
+                        for (std::size_t j = 0; j < cols; ++j) r(i, j) += x * rhs(kk, j);
+                    }
+                }
+            }
+        };
+        // whole row blocks per thread, and enough work to pay for starting one
+        const std::size_t per = matrix_detail::row_block;
+        const std::size_t blocks = (n + per - 1) / per;
+        const std::size_t workers = std::min<std::size_t>({threads, blocks, n * k * cols / (1 << 18) + 1});
+        if (workers <= 1) {
+            run(0, n);
+            return r;
+        }
+        std::vector<std::thread> pool;
+        for (std::size_t t = 0; t < workers; ++t) {
+            const std::size_t r0 = std::min(n, blocks * t / workers * per), r1 = std::min(n, blocks * (t + 1) / workers * per);
+            if (r0 < r1) pool.emplace_back(run, r0, r1);
+        }
+        for (auto& th: pool) th.join();
+        return r;
+    }
+
+    /* this^e by repeated squaring, square matrices only */
+    Matrix pow(u64 e) const {
+        if (n != m) throw std::invalid_argument("Matrix: pow of a non-square matrix");
+        Matrix r = identity(n), b = *this;
+        while (e) {
+            if (e & 1) r = r * b;
+            e >>= 1;
+            if (e) b = b * b;
+        }
+        return r;
+    }
+
+    /* Gaussian elimination to reduced row echelon form, in place
+     * Returns the rank; the sign of the row permutation goes to *sign.
+     * Only the first `cols` columns are used as pivots.
+     */
+    std::size_t eliminate(int* sign = nullptr, std::size_t cols = ~std::size_t(0)) {
+        cols = std::min(cols, m);
+        std::size_t rank = 0;
+        int s = 1;
+        for (std::size_t col = 0; col < cols && rank < n; ++col) {
+            std::size_t piv = rank;
+            while (piv < n && !(*this)(piv, col)) ++piv;
+            if (piv == n) continue;
+            if (piv != rank) {
+                std::swap_ranges((*this)[piv], (*this)[piv] + m, (*this)[rank]);
+                s = -s;
+            }
+            T* p = (*this)[rank];
+            matrix_detail::scale(p + col, (*this)(rank, col).inv(), m - col);
+            for (std::size_t i = 0; i < n; ++i) {
+                if (i == rank || !(*this)(i, col)) continue;
+                matrix_detail::axpy((*this)[i] + col, -(*this)(i, col), p + col, m - col);
+            }
+            ++rank;
+        }
+        if (sign) *sign = s;
+        return rank;
+    }
+
+    std::size_t rank() const { return Matrix(*this).eliminate(); }
+
+    /* Determinant by forward elimination, square matrices only */
+    T det() const {
+        if (n != m) throw std::invalid_argument("Matrix: determinant of a non-square matrix");
+        Matrix b(*this);
+        T d = 1;
+        for (std::size_t col = 0; col < n; ++col) {
+            std::size_t piv = col;
+            while (piv < n && !b(piv, col)) ++piv;
+            if (piv == n) return T(0);
+            if (piv != col) {
+                std::swap_ranges(b[piv], b[piv] + n, b[col]);
+                d = -d;
+            }
+            d *= b(col, col);
+            const T inv = b(col, col).inv();
+            for (std::size_t i = col + 1; i < n; ++i) {
+                if (!b(i, col)) continue;
+                matrix_detail::axpy(b[i] + col, -(b(i, col) * inv), b[col] + col, n - col);
+            }
+        }
+        return d;
+    }
+
+    /* Inverse by Gauss-Jordan elimination on [A | I]
+     * Throws std::domain_error if the matrix is singular.
+     */
+    Matrix inverse() const {
+        if (n != m) throw std::invalid_argument("Matrix: inverse of a non-square matrix");
+        Matrix b(n, 2 * n);
+        for (std::size_t i = 0; i < n; ++i) {
+            std::copy((*this)[i], (*this)[i] + n, b[i]);
+            b(i, n + i) = T(1);
+        }
+        if (b.eliminate(nullptr, n) < n) throw std::domain_error("Matrix: singular matrix");
+        Matrix r(n, n);
+        for (std::size_t i = 0; i < n; ++i) std::copy(b[i] + n, b[i] + 2 * n, r[i]);
+        return r;
+    }
+};
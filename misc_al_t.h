@@ -8,10 +8,10 @@ using i64 = std::int64_t;
 using u64 = std::uint64_t;
 
 template <typename T>
-T binpow_fibonacci(int n);
+T binpow_fibonacci(u64 n);
 
 template <typename T>
-T binpow_narayana(int n);
+T binpow_narayana(u64 n);
 
 template <typename T>
 T fast_fibonacci(u64 n);
@@ -48,14 +48,15 @@ inline unsigned int msb(u64 n) {
 }
 
 /* Utilises matrices to rapidly calculate F_n. Starts from the bit after MSB.
+   Recurrences of any order over Field<Mod> are in recurrence.h.
    */
 template <typename T>
-T binpow_fibonacci(int n) {
+T binpow_fibonacci(u64 n) {
     if (n < 2) {
         return n == 1 ? 1 : 0;
     }
     T a = 1, b = 1, c = 0; // matrix {{1, 1},{1,0}} = {{a, b}, {b, c}}
-    int i = 1 << msb(n);
+    u64 i = u64(1) << msb(n);
     while (i >>= 1) {
         T t = b * b;
         b = b * (a + c);
@@ -73,15 +74,15 @@ T binpow_fibonacci(int n) {
 /* Rapidly counts Narayana's cows = N_n = N_n-1 + N_n-3
    */
 template <typename T>
-T binpow_narayana(int n) {
+T binpow_narayana(u64 n) {
     // {{1,0,1},{1,0,0},{0,1,0}} = {{a,c,b},{b,d,c},{c,e,d}}
     T a = 1, b = 1, c = 0;
-    int i = 1 << msb(n); // the MSB, safe because n > 1
+    u64 i = u64(1) << msb(n); // the MSB, safe because n > 1
     while (i >>= 1) {
-        T t1 = 2 * b * c;
+        T t1 = T(2) * b * c;
         T t2 = b * b;
-        b = c * c + 2 * a * b - t2;
-        c = t2 + 2 * a * c - t1;
+        b = c * c + T(2) * a * b - t2;
+        c = t2 + T(2) * a * c - t1;
         a = a * a + t1;
         if (n & i) {
             T t_c = c;
@@ -102,10 +103,10 @@ T fast_fibonacci(u64 n) {
     }
     T fn = 1;
     T fnm = 0;
-    int i = 1 << msb(n);
+    u64 i = u64(1) << msb(n);
     while (i >>= 1) {
         T f2nm = fn * fn + fnm * fnm;
-        T f2n = fn * (2 * fnm + fn);
+        T f2n = fn * (T(2) * fnm + fn);
         fn = n & i ? f2n + f2nm : f2n;
         fnm = n & i ? f2n : f2nm;
     }
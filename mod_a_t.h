@@ -2,66 +2,275 @@
 #include <cstdint>
 #include <algorithm>
 #include <limits>
+#include <type_traits>
 #include <vector>
 
 using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+using u128 = unsigned __int128;
 
 template <typename T>
-T mod_mult(T a, T b, T mod);
+constexpr T mod_mult(T a, T b, T mod);
 
 template <typename T1, typename T2>
-T1 mod_exp(T1 a, T2 e, T1 mod);
+constexpr T1 mod_exp(T1 a, T2 e, T1 mod);
 
-/* Modular multiplication
-   0 <= a, b < 2^64, 0 < mod < 2^63 (for T_t)
-   */
+/* a mod mod in [0, mod), also for negative a */
 template <typename T>
-T mod_mult(T a, T b, const T mod) {
-    if (a >= mod || a < 0) a = (a % mod + mod) % mod;
-    if (b >= mod || b < 0) b = (b % mod + mod) % mod;
-    if ((a | b) < std::numeric_limits<u32>::max()) {
-        return (a * b) % mod;
+constexpr T mod_norm(T a, const T mod) {
+    a %= mod;
+    if constexpr (std::numeric_limits<T>::is_signed) {
+        if (a < 0) a += mod;
     }
+    return a;
+}
 
-    T r = 0;         // remainder
-    T m = mod >> 1;  // for n < m, if 2 * n > mod -> 2n % mod
+/* Sliding-window exponentiation
+   x^e in the representation of ctx (Montgomery64 or Barrett64), x reduced.
+   Windows of up to k bits start and end in a set bit, so only the odd
+   powers x, x^3, ..., x^(2^k - 1) are tabulated.
+   */
+template <typename Ctx, typename T>
+constexpr u64 window_pow(const Ctx& ctx, const u64 x, const T e) {
+    const u64 ue = static_cast<u64>(e);
+    if (ue == 0) return ctx.one();
+    const int bits = 64 - __builtin_clzll(ue);
+    const int k = bits <= 8 ? 1 : bits <= 24 ? 3 : 4;
 
-    if (b > a) std::swap(a, b);
+    u64 tab[8] = {x};
+    if (k > 1) {
+        const u64 x2 = ctx.mul(x, x);
+        for (int i = 1; i < 1 << (k - 1); ++i) tab[i] = ctx.mul(tab[i - 1], x2);
+    }
 
-    while (b) {
-        // multiplies "a" by "b" bit by bit, cf long multiplication
-        if (b & 1) {
-            r += a;
-            if (r >= mod) r -= mod;
+    u64 r = ctx.one();
+    bool first = true;
+    for (int i = bits - 1; i >= 0;) {
+        if (!(ue >> i & 1)) {
+            r = ctx.mul(r, r);
+            --i;
+            continue;
+        }
+        int j = i - k + 1 > 0 ? i - k + 1 : 0;
+        while (!(ue >> j & 1)) ++j;
+        const u64 w = (ue >> j) & ((u64(1) << (i - j + 1)) - 1);
+        if (first) {
+            r = tab[w >> 1];
+            first = false;
+        } else {
+            for (int s = i; s >= j; --s) r = ctx.mul(r, r);
+            r = ctx.mul(r, tab[w >> 1]);
         }
-        b >>= 1;
-        a = a > m ? (a << 1) - mod : a << 1;
+        i = j - 1;
     }
     return r;
 }
 
+/* Montgomery form modulo a fixed odd mod, 1 <= mod < 2^64, R = 2^64
+   x is held as x*R mod mod; a product then reduces with two multiplications
+   instead of a 128-bit division. Values passed in are below mod.
+   */
+class Montgomery64 {
+private:
+    u64 n;
+    u64 n_inv;  // n^-1 mod 2^64
+    u64 r1;     // R mod n
+    u64 r2;     // R^2 mod n
+
+public:
+    constexpr explicit Montgomery64(const u64 mod) noexcept : n(mod), n_inv(mod), r1(0), r2(0) {
+        // Newton iteration, correct to 3 bits for odd n and doubling every step
+        for (int i = 0; i < 5; ++i) n_inv *= 2 - n * n_inv;
+        r1 = (0 - n) % n;
+        r2 = static_cast<u128>(r1) * r1 % n;
+    }
+
+    constexpr u64 mod() const noexcept { return n; }
+    constexpr u64 one() const noexcept { return r1; }
+
+    /* t * R^-1 mod n for t < n * 2^64 */
+    constexpr u64 redc(const u128 t) const noexcept {
+        const u64 m = static_cast<u64>(t) * n_inv;
+        const u64 mn = static_cast<u128>(m) * n >> 64;
+        const u64 hi = t >> 64;
+        return hi < mn ? hi - mn + n : hi - mn;
+    }
+
+    constexpr u64 to(const u64 a) const noexcept { return redc(static_cast<u128>(a % n) * r2); }
+    constexpr u64 from(const u64 a) const noexcept { return redc(a); }
+
+    constexpr u64 mul(const u64 a, const u64 b) const noexcept { return redc(static_cast<u128>(a) * b); }
+
+    // a + b >= n compared as a >= n - b, so nothing overflows and it compiles to a cmov
+    constexpr u64 add(const u64 a, const u64 b) const noexcept {
+        const u64 s = a - (n - b);
+        return a < n - b ? s + n : s;
+    }
+
+    constexpr u64 sub(const u64 a, const u64 b) const noexcept { return a < b ? a - b + n : a - b; }
+
+    /* a^e, a and the result in Montgomery form */
+    template <typename T>
+    constexpr u64 pow(const u64 a, const T e) const noexcept { return window_pow(*this, a, e); }
+};
+
+/* Barrett reduction modulo a fixed mod, 1 <= mod < 2^64
+   m = floor((2^128 - 1) / mod); the quotient x / mod is estimated from the
+   high half of x * m, at most two below the true value.
+   */
+class Barrett64 {
+private:
+    u64 n;
+    u128 m;
+
+public:
+    constexpr explicit Barrett64(const u64 mod) noexcept : n(mod), m(~u128(0) / mod) {}
+
+    constexpr u64 mod() const noexcept { return n; }
+
+    /* x mod n for any x < 2^128 */
+    constexpr u64 reduce(const u128 x) const noexcept {
+        const u64 x_lo = static_cast<u64>(x), x_hi = x >> 64;
+        const u64 m_lo = static_cast<u64>(m), m_hi = m >> 64;
+        const u128 lo = static_cast<u128>(x_lo) * m_lo;
+        const u128 mid1 = static_cast<u128>(x_lo) * m_hi;
+        const u128 mid2 = static_cast<u128>(x_hi) * m_lo;
+        const u128 mid = (lo >> 64) + static_cast<u64>(mid1) + static_cast<u64>(mid2);
+        const u128 q = static_cast<u128>(x_hi) * m_hi + (mid1 >> 64) + (mid2 >> 64) + (mid >> 64);
+        u128 r = x - q * n;
+        while (r >= n) r -= n;
+        return static_cast<u64>(r);
+    }
+
+    // Barrett needs no special form; to/from/one mirror Montgomery64
+    constexpr u64 to(const u64 a) const noexcept { return a % n; }
+    constexpr u64 from(const u64 a) const noexcept { return a; }
+    constexpr u64 one() const noexcept { return 1 % n; }
+
+    constexpr u64 mul(const u64 a, const u64 b) const noexcept { return reduce(static_cast<u128>(a) * b); }
+
+    /* a^e mod n */
+    template <typename T>
+    constexpr u64 pow(const u64 a, const T e) const noexcept { return window_pow(*this, to(a), e); }
+};
+
+/* Modular multiplication
+   0 < mod < 2^64, a and b of any sign
+   */
+template <typename T>
+constexpr T mod_mult(T a, T b, const T mod) {
+    if (a >= mod || a < 0) a = mod_norm(a, mod);
+    if (b >= mod || b < 0) b = mod_norm(b, mod);
+    if ((a | b) < std::numeric_limits<u32>::max()) {
+        return static_cast<u64>(a) * static_cast<u64>(b) % static_cast<u64>(mod);
+    }
+    return static_cast<T>(static_cast<u128>(a) * static_cast<u128>(b) % static_cast<u64>(mod));
+}
+
+/* Modular inverse
+   Extended Euclidean algorithm, gcd(a, mod) has to be 1
+   The coefficients alternate in sign and stay below mod in magnitude, so
+   they are kept unsigned with the sign tracked apart, for any mod < 2^64
+   0 <= a < mod
+   */
+template <typename T>
+constexpr T mod_inv(const T a, const T mod) {
+    T r0 = mod, r1 = a;
+    T s0 = 0, s1 = 1;
+    bool neg = true;  // sign of s0, s1 has the other one
+    while (r1) {
+        const T q = r0 / r1;
+        T t = r0 - q * r1;
+        r0 = r1;
+        r1 = t;
+        const T u = s0 + q * s1;
+        s0 = s1;
+        s1 = u;
+        neg = !neg;
+    }
+    return neg && s0 ? mod - s0 : s0;
+}
+
 /* Modular exponentiation
-   Exponentiation by squaring
-   0 <= a, e < 2^64, 0 < mod < 2^63 (for uint64_t)
+   Sliding-window exponentiation in Montgomery form for odd moduli,
+   with Barrett reduction for even ones
+   0 <= e, 0 < mod < 2^64
    */
 template <typename T1, typename T2>
-T1 mod_exp(T1 a, T2 e, const T1 mod) {
-    T1 r = 1;
-    if (a >= mod || a < 0) a = (a % mod + mod) % mod;
-
-    if (mod < std::numeric_limits<u32>::max()) {
-        while (e) {
-            if (e & 1) r = r * a % mod;
-            e >>= 1;
-            a = a * a % mod;
+constexpr T1 mod_exp(T1 a, T2 e, const T1 mod) {
+    if (a >= mod || a < 0) a = mod_norm(a, mod);
+    const u64 n = static_cast<u64>(mod);
+    if (n & 1) {
+        const Montgomery64 mont(n);
+        return static_cast<T1>(mont.from(mont.pow(mont.to(a), e)));
+    }
+    const Barrett64 bar(n);
+    return static_cast<T1>(bar.pow(static_cast<u64>(a), e));
+}
+
+/* Fixed-base exponentiation
+   Lim-Lee comb: the exponent's bits are laid out in h rows of a = bits/h
+   columns, split into v blocks of b = a/v columns. For each block s and
+   each h-bit column pattern j, table[s][j] = g^(sum over set bits i of
+   2^(i*a + s*b)). A power then costs b - 1 squarings and at most a
+   multiplications. The tables are built once and only read by pow, so one
+   object can be shared between threads.
+   Ctx is Montgomery64 (odd mod) or Barrett64 (any mod).
+   */
+template <typename Ctx = Montgomery64>
+class FixedBase {
+private:
+    Ctx ctx;
+    int h, v, a, b;
+    std::vector<u64> table;  // v blocks of 2^h entries
+
+    /* column t of block s of e as an h-bit row index */
+    u64 column(const u64 e, const int s, const int t) const noexcept {
+        u64 j = 0;
+        for (int i = 0; i < h; ++i) {
+            const int pos = i * a + s * b + t;
+            if (pos < 64 && t < b && s * b + t < a) j |= (e >> pos & 1) << i;
         }
+        return j;
     }
-    else {
-        while (e) {
-            if (e & 1) r = mod_mult(a, r, mod);
-            e >>= 1;
-            a = mod_mult(a, a, mod);
+
+public:
+    /* g^e for e < 2^bits; h * v table entries of 2^h each */
+    FixedBase(const u64 g, const u64 mod, const int bits = 64, const int h = 8, const int v = 2)
+        : ctx(mod), h(h), v(v), a((bits + h - 1) / h), b((a + v - 1) / v), table(std::size_t(v) << h) {
+        std::vector<u64> rows(h);
+        rows[0] = ctx.to(g % mod);
+        for (int i = 1; i < h; ++i) {
+            rows[i] = rows[i - 1];
+            for (int t = 0; t < a; ++t) rows[i] = ctx.mul(rows[i], rows[i]);
+        }
+        for (int s = 0; s < v; ++s) {
+            u64* blk = table.data() + (std::size_t(s) << h);
+            blk[0] = ctx.one();
+            for (int i = 0; i < h; ++i) {
+                for (u64 j = 0; j < u64(1) << i; ++j) blk[j | u64(1) << i] = ctx.mul(blk[j], rows[i]);
+            }
+            // advance every row by b squarings for the next block
+            for (int i = 0; i < h; ++i) {
+                for (int t = 0; t < b; ++t) rows[i] = ctx.mul(rows[i], rows[i]);
+            }
         }
     }
-    return r;
-}
+
+    u64 mod() const noexcept { return ctx.mod(); }
+
+    /* g^e mod mod */
+    template <typename T>
+    u64 pow(const T e) const noexcept {
+        const u64 ue = static_cast<u64>(e);
+        u64 r = ctx.one();
+        for (int t = b - 1; t >= 0; --t) {
+            if (t != b - 1) r = ctx.mul(r, r);
+            for (int s = 0; s < v; ++s) {
+                const u64 j = column(ue, s, t);
+                if (j) r = ctx.mul(r, table[(std::size_t(s) << h) | j]);
+            }
+        }
+        return ctx.from(r);
+    }
+};
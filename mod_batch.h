@@ -0,0 +1,312 @@
+#pragma once
+#include "mod_a_t.h"
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Batch modular arithmetic
+   out[i] = a[i] * b[i] mod mod and out[i] = base[i]^e[i] mod mod for
+   i < count, with one modulus shared by the whole batch. Results equal
+   mod_mult and mod_exp element by element.
+   Odd moduli run Montgomery multiplication across SIMD lanes, picked at
+   runtime: AVX-512 IFMA (52-bit multipliers) for mod < 2^52, AVX2
+   (32-bit multipliers) for mod < 2^32. Other odd moduli interleave several
+   independent scalar Montgomery chains, even moduli use Barrett64.
+   Exponentiation uses fixed 4-bit windows, so every lane in a block runs
+   the same sequence of multiplications.
+   */
+
+inline void mod_mult_batch(const u64* a, const u64* b, u64* out, std::size_t count, u64 mod);
+inline void mod_exp_batch(const u64* base, const u64* e, u64* out, std::size_t count, u64 mod);
+
+namespace mod_batch_detail {
+
+constexpr int lanes = 8;
+
+/* Montgomery constants for R = 2^bits, odd n < 2^bits */
+struct mont_consts {
+    u64 n, ninv, one, r2;
+
+    mont_consts(const u64 n, const int bits) : n(n) {
+        const u64 mask = bits == 64 ? ~u64(0) : (u64(1) << bits) - 1;
+        ninv = n;
+        for (int i = 0; i < 5; ++i) ninv *= 2 - n * ninv;
+        ninv &= mask;
+        one = static_cast<u64>((u128(1) << bits) % n);
+        r2 = static_cast<u64>(u128(one) * one % n);
+    }
+};
+
+/* copy up to lanes values, reduced below n, zero padded */
+inline void load_reduced(u64* dst, const u64* src, const std::size_t k, const u64 n) {
+    for (std::size_t i = 0; i < lanes; ++i) {
+        const u64 x = i < k ? src[i] : 0;
+        dst[i] = x < n ? x : x % n;
+    }
+}
+
+inline void load_exps(u64* dst, const u64* src, const std::size_t k) {
+    for (std::size_t i = 0; i < lanes; ++i) dst[i] = i < k ? src[i] : 0;
+}
+
+inline int exp_bits(const u64* e) {
+    u64 any = 0;
+    for (int i = 0; i < lanes; ++i) any |= e[i];
+    return any ? 64 - __builtin_clzll(any) : 0;
+}
+
+/* Scalar fallback, lanes independent Montgomery64 chains so the
+   multiplier latency overlaps */
+inline void exp_scalar(const u64* base, const u64* e, u64* out, const std::size_t count, const u64 mod) {
+    const Montgomery64 mont(mod);
+    u64 x[lanes], ex[lanes], r[lanes], tab[16][lanes];
+    for (std::size_t i = 0; i < count; i += lanes) {
+        const std::size_t k = count - i < lanes ? count - i : lanes;
+        load_reduced(x, base + i, k, mod);
+        load_exps(ex, e + i, k);
+        for (int l = 0; l < lanes; ++l) {
+            tab[0][l] = mont.one();
+            tab[1][l] = mont.to(x[l]);
+        }
+        for (int d = 2; d < 16; ++d) {
+            for (int l = 0; l < lanes; ++l) tab[d][l] = mont.mul(tab[d - 1][l], tab[1][l]);
+        }
+        int s = (exp_bits(ex) + 3) / 4 * 4 - 4;
+        for (int l = 0; l < lanes; ++l) r[l] = tab[s < 0 ? 0 : ex[l] >> s & 15][l];
+        for (s -= 4; s >= 0; s -= 4) {
+            for (int j = 0; j < 4; ++j) {
+                for (int l = 0; l < lanes; ++l) r[l] = mont.mul(r[l], r[l]);
+            }
+            for (int l = 0; l < lanes; ++l) r[l] = mont.mul(r[l], tab[ex[l] >> s & 15][l]);
+        }
+        for (std::size_t l = 0; l < k; ++l) out[i + l] = mont.from(r[l]);
+    }
+}
+
+inline void mult_scalar(const u64* a, const u64* b, u64* out, const std::size_t count, const u64 mod) {
+    const Montgomery64 mont(mod);
+    const u64 r2 = mont.to(mont.one());
+    for (std::size_t i = 0; i < count; ++i) {
+        const u64 x = a[i] < mod ? a[i] : a[i] % mod, y = b[i] < mod ? b[i] : b[i] % mod;
+        out[i] = mont.mul(mont.mul(x, y), r2);
+    }
+}
+
+#if defined(__x86_64__)
+
+/* Montgomery product for R = 2^52, a, b < n < 2^52 */
+__attribute__((target("avx512f,avx512ifma")))
+inline __m512i mul_ifma(const __m512i a, const __m512i b, const __m512i n, const __m512i ninv) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lo = _mm512_madd52lo_epu64(zero, a, b);
+    const __m512i hi = _mm512_madd52hi_epu64(zero, a, b);
+    const __m512i m = _mm512_madd52lo_epu64(zero, lo, ninv);
+    // low 52 bits of m * n equal lo, so only the high halves differ
+    const __m512i mh = _mm512_madd52hi_epu64(zero, m, n);
+    const __mmask8 borrow = _mm512_cmpgt_epu64_mask(mh, hi);
+    const __m512i r = _mm512_sub_epi64(hi, mh);
+    return _mm512_mask_add_epi64(r, borrow, r, n);
+}
+
+/* tab[digit s of e][lane] for each lane, tables laid out lane-minor */
+__attribute__((target("avx512f")))
+inline __m512i digit_ifma(const __m512i e, const int s, const u64* tab) {
+    const __m512i lane = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i d = _mm512_and_si512(_mm512_srl_epi64(e, _mm_cvtsi32_si128(s)), _mm512_set1_epi64(15));
+    return _mm512_i64gather_epi64(_mm512_or_si512(_mm512_slli_epi64(d, 3), lane), tab, 8);
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+inline void exp_ifma(const u64* base, const u64* e, u64* out, const std::size_t count, const u64 mod) {
+    const mont_consts c(mod, 52);
+    const __m512i n = _mm512_set1_epi64(c.n), ninv = _mm512_set1_epi64(c.ninv);
+    const __m512i r2 = _mm512_set1_epi64(c.r2), one = _mm512_set1_epi64(1);
+    alignas(64) u64 x[lanes], ex[lanes], tab[16 * lanes];
+    for (std::size_t i = 0; i < count; i += lanes) {
+        const std::size_t k = count - i < lanes ? count - i : lanes;
+        load_reduced(x, base + i, k, mod);
+        load_exps(ex, e + i, k);
+        const __m512i xm = mul_ifma(_mm512_load_si512(x), r2, n, ninv);
+        __m512i p = _mm512_set1_epi64(c.one);
+        _mm512_store_si512(tab, p);
+        for (int d = 1; d < 16; ++d) {
+            p = mul_ifma(p, xm, n, ninv);
+            _mm512_store_si512(tab + d * lanes, p);
+        }
+        const __m512i ev = _mm512_load_si512(ex);
+        int s = (exp_bits(ex) + 3) / 4 * 4 - 4;
+        __m512i r = s < 0 ? _mm512_set1_epi64(c.one) : digit_ifma(ev, s, tab);
+        for (s -= 4; s >= 0; s -= 4) {
+            r = mul_ifma(r, r, n, ninv);
+            r = mul_ifma(r, r, n, ninv);
+            r = mul_ifma(r, r, n, ninv);
+            r = mul_ifma(r, r, n, ninv);
+            r = mul_ifma(r, digit_ifma(ev, s, tab), n, ninv);
+        }
+        _mm512_store_si512(x, mul_ifma(r, one, n, ninv));
+        for (std::size_t l = 0; l < k; ++l) out[i + l] = x[l];
+    }
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+inline void mult_ifma(const u64* a, const u64* b, u64* out, const std::size_t count, const u64 mod) {
+    const mont_consts c(mod, 52);
+    const __m512i n = _mm512_set1_epi64(c.n), ninv = _mm512_set1_epi64(c.ninv);
+    const __m512i r2 = _mm512_set1_epi64(c.r2);
+    alignas(64) u64 x[lanes], y[lanes];
+    std::size_t i = 0;
+    // full blocks of reduced operands go straight from memory
+    for (; i + lanes <= count; i += lanes) {
+        const __m512i va = _mm512_loadu_si512(a + i), vb = _mm512_loadu_si512(b + i);
+        if (_mm512_cmpge_epu64_mask(va, n) | _mm512_cmpge_epu64_mask(vb, n)) break;
+        _mm512_storeu_si512(out + i, mul_ifma(mul_ifma(va, vb, n, ninv), r2, n, ninv));
+    }
+    for (; i < count; i += lanes) {
+        const std::size_t k = count - i < lanes ? count - i : lanes;
+        load_reduced(x, a + i, k, mod);
+        load_reduced(y, b + i, k, mod);
+        const __m512i p = mul_ifma(_mm512_load_si512(x), _mm512_load_si512(y), n, ninv);
+        _mm512_store_si512(x, mul_ifma(p, r2, n, ninv));
+        for (std::size_t l = 0; l < k; ++l) out[i + l] = x[l];
+    }
+}
+
+/* Montgomery product for R = 2^32 in 64-bit lanes, a, b < n < 2^32 */
+__attribute__((target("avx2")))
+inline __m256i mul_avx2(const __m256i a, const __m256i b, const __m256i n, const __m256i ninv) {
+    const __m256i t = _mm256_mul_epu32(a, b);
+    const __m256i m = _mm256_mul_epu32(t, ninv);
+    const __m256i mn = _mm256_mul_epu32(m, n);
+    const __m256i hi = _mm256_srli_epi64(t, 32), mh = _mm256_srli_epi64(mn, 32);
+    const __m256i borrow = _mm256_cmpgt_epi64(mh, hi);
+    return _mm256_add_epi64(_mm256_sub_epi64(hi, mh), _mm256_and_si256(borrow, n));
+}
+
+__attribute__((target("avx2")))
+inline __m256i digit_avx2(const __m256i e, const __m256i lane, const int s, const u64* tab) {
+    const __m256i d = _mm256_and_si256(_mm256_srl_epi64(e, _mm_cvtsi32_si128(s)), _mm256_set1_epi64x(15));
+    return _mm256_i64gather_epi64((const long long*)tab, _mm256_or_si256(_mm256_slli_epi64(d, 3), lane), 8);
+}
+
+/* two vectors of four lanes per block, for the same block size as the
+   other kernels and two independent dependency chains */
+__attribute__((target("avx2")))
+inline void exp_avx2(const u64* base, const u64* e, u64* out, const std::size_t count, const u64 mod) {
+    const mont_consts c(mod, 32);
+    const __m256i n = _mm256_set1_epi64x(c.n), ninv = _mm256_set1_epi64x(c.ninv);
+    const __m256i r2 = _mm256_set1_epi64x(c.r2), one = _mm256_set1_epi64x(1);
+    const __m256i lane0 = _mm256_set_epi64x(3, 2, 1, 0), lane1 = _mm256_set_epi64x(7, 6, 5, 4);
+    alignas(32) u64 x[lanes], ex[lanes], tab[16 * lanes];
+    for (std::size_t i = 0; i < count; i += lanes) {
+        const std::size_t k = count - i < lanes ? count - i : lanes;
+        load_reduced(x, base + i, k, mod);
+        load_exps(ex, e + i, k);
+        const __m256i x0 = mul_avx2(_mm256_load_si256((const __m256i*)x), r2, n, ninv);
+        const __m256i x1 = mul_avx2(_mm256_load_si256((const __m256i*)(x + 4)), r2, n, ninv);
+        __m256i p0 = _mm256_set1_epi64x(c.one), p1 = p0;
+        _mm256_store_si256((__m256i*)tab, p0);
+        _mm256_store_si256((__m256i*)(tab + 4), p1);
+        for (int d = 1; d < 16; ++d) {
+            p0 = mul_avx2(p0, x0, n, ninv);
+            p1 = mul_avx2(p1, x1, n, ninv);
+            _mm256_store_si256((__m256i*)(tab + d * lanes), p0);
+            _mm256_store_si256((__m256i*)(tab + d * lanes + 4), p1);
+        }
+        const __m256i e0 = _mm256_load_si256((const __m256i*)ex), e1 = _mm256_load_si256((const __m256i*)(ex + 4));
+        int s = (exp_bits(ex) + 3) / 4 * 4 - 4;
+        __m256i r0 = _mm256_set1_epi64x(c.one), r1 = r0;
+        if (s >= 0) {
+            r0 = digit_avx2(e0, lane0, s, tab);
+            r1 = digit_avx2(e1, lane1, s, tab);
+        }
+        for (s -= 4; s >= 0; s -= 4) {
+            for (int j = 0; j < 4; ++j) {
+                r0 = mul_avx2(r0, r0, n, ninv);
+                r1 = mul_avx2(r1, r1, n, ninv);
+            }
+            r0 = mul_avx2(r0, digit_avx2(e0, lane0, s, tab), n, ninv);
+            r1 = mul_avx2(r1, digit_avx2(e1, lane1, s, tab), n, ninv);
+        }
+        _mm256_store_si256((__m256i*)x, mul_avx2(r0, one, n, ninv));
+        _mm256_store_si256((__m256i*)(x + 4), mul_avx2(r1, one, n, ninv));
+        for (std::size_t l = 0; l < k; ++l) out[i + l] = x[l];
+    }
+}
+
+__attribute__((target("avx2")))
+inline void mult_avx2(const u64* a, const u64* b, u64* out, const std::size_t count, const u64 mod) {
+    const mont_consts c(mod, 32);
+    const __m256i n = _mm256_set1_epi64x(c.n), ninv = _mm256_set1_epi64x(c.ninv);
+    const __m256i r2 = _mm256_set1_epi64x(c.r2);
+    const __m256i n1 = _mm256_set1_epi64x(c.n - 1);
+    alignas(32) u64 x[4], y[4];
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i va = _mm256_loadu_si256((const __m256i*)(a + i)), vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        // AVX2 compares are signed, so rule out high bits before comparing with n - 1
+        if (!_mm256_testz_si256(_mm256_or_si256(va, vb), _mm256_set1_epi64x(~u64(0) << 32))) break;
+        const __m256i big = _mm256_or_si256(_mm256_cmpgt_epi64(va, n1), _mm256_cmpgt_epi64(vb, n1));
+        if (!_mm256_testz_si256(big, big)) break;
+        _mm256_storeu_si256((__m256i*)(out + i), mul_avx2(mul_avx2(va, vb, n, ninv), r2, n, ninv));
+    }
+    for (; i < count; i += 4) {
+        const std::size_t k = count - i < 4 ? count - i : 4;
+        for (std::size_t l = 0; l < 4; ++l) {
+            x[l] = l < k ? (a[i + l] < mod ? a[i + l] : a[i + l] % mod) : 0;
+            y[l] = l < k ? (b[i + l] < mod ? b[i + l] : b[i + l] % mod) : 0;
+        }
+        const __m256i p = mul_avx2(_mm256_load_si256((const __m256i*)x), _mm256_load_si256((const __m256i*)y), n, ninv);
+        _mm256_store_si256((__m256i*)x, mul_avx2(p, r2, n, ninv));
+        for (std::size_t l = 0; l < k; ++l) out[i + l] = x[l];
+    }
+}
+
+#endif
+
+enum class isa { scalar, avx2, ifma };
+
+/* widest kernel usable for mod on this CPU */
+inline isa select(const u64 mod) {
+#if defined(__x86_64__)
+    static const bool has_ifma = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (mod > 1 && (mod & 1)) {
+        if (has_ifma && mod < u64(1) << 52) return isa::ifma;
+        if (has_avx2 && mod < u64(1) << 32) return isa::avx2;
+    }
+#endif
+    (void)mod;
+    return isa::scalar;
+}
+
+} // namespace mod_batch_detail
+
+inline void mod_mult_batch(const u64* a, const u64* b, u64* out, const std::size_t count, const u64 mod) {
+    using namespace mod_batch_detail;
+    switch (select(mod)) {
+#if defined(__x86_64__)
+        case isa::ifma: return mult_ifma(a, b, out, count, mod);
+        case isa::avx2: return mult_avx2(a, b, out, count, mod);
+#endif
+        default: break;
+    }
+    if (mod & 1) return mult_scalar(a, b, out, count, mod);
+    const Barrett64 bar(mod);
+    for (std::size_t i = 0; i < count; ++i) out[i] = bar.mul(a[i], b[i]);
+}
+
+inline void mod_exp_batch(const u64* base, const u64* e, u64* out, const std::size_t count, const u64 mod) {
+    using namespace mod_batch_detail;
+    switch (select(mod)) {
+#if defined(__x86_64__)
+        case isa::ifma: return exp_ifma(base, e, out, count, mod);
+        case isa::avx2: return exp_avx2(base, e, out, count, mod);
+#endif
+        default: break;
+    }
+    if (mod & 1) return exp_scalar(base, e, out, count, mod);
+    const Barrett64 bar(mod);
+    for (std::size_t i = 0; i < count; ++i) out[i] = bar.pow(base[i], e[i]);
+}
@@ -0,0 +1,385 @@
+#pragma once
+#include "field.h"
+#include "field_vector.h"
+#include "primitive_root.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/* Polynomials over Field<Mod>, coefficients from the constant term up.
+ * Transforms need Mod prime with 2^k dividing Mod - 1 for the transform
+ * lengths used, e.g. 998244353 = 119*2^23 + 1.
+ * */
+
+template <i64 Mod>
+using Poly = std::vector<Field<Mod>>;
+
+template <i64 Mod>
+void ntt(Poly<Mod>& a);
+
+template <i64 Mod>
+void intt(Poly<Mod>& a);
+
+template <i64 Mod>
+Poly<Mod> poly_mul(const Poly<Mod>& a, const Poly<Mod>& b);
+
+template <i64 Mod>
+Poly<Mod> poly_inv(const Poly<Mod>& a, std::size_t n);
+
+template <i64 Mod>
+std::pair<Poly<Mod>, Poly<Mod>> poly_divmod(const Poly<Mod>& a, const Poly<Mod>& b);
+
+template <i64 Mod>
+std::vector<Field<Mod>> poly_eval(const Poly<Mod>& a, const std::vector<Field<Mod>>& x);
+
+template <i64 Mod>
+Poly<Mod> poly_interpolate(const std::vector<Field<Mod>>& x, const std::vector<Field<Mod>>& y);
+
+namespace poly_detail {
+
+// below these sizes the quadratic algorithms win
+constexpr std::size_t mul_cutoff = 32;
+constexpr std::size_t div_cutoff = 64;
+constexpr std::size_t eval_cutoff = 32;
+
+template <i64 Mod>
+Field<Mod> generator() {
+    static const Field<Mod> g(primitive_root<i64>(Mod));
+    return g;
+}
+
+/* rt[h + j] = w^j for every power of two h < len, w a primitive 2h-th root
+ * of unity (or its inverse). Shorter transforms use a prefix of the table.
+ */
+template <i64 Mod>
+Poly<Mod> build_roots(const std::size_t len, const bool invert) {
+    Poly<Mod> rt(len);
+    const std::size_t half = len / 2;
+    Field<Mod> w = generator<Mod>().pow((Mod - 1) / static_cast<i64>(len));
+    if (invert) w = w.inv();
+    rt[half] = 1;
+    for (std::size_t j = 1; j < half; ++j) rt[half + j] = rt[half + j - 1] * w;
+    for (std::size_t h = half / 2; h >= 1; h /= 2) {
+        for (std::size_t j = 0; j < h; ++j) rt[h + j] = rt[2 * (h + j)];
+    }
+    return rt;
+}
+
+/* The root table for transforms of length up to len, a power of two
+ * dividing Mod - 1. One table per Mod and direction is kept and rebuilt
+ * only when a longer transform asks for it; a caller holds on to the
+ * table it got, so growing it under another thread is safe.
+ */
+template <i64 Mod>
+std::shared_ptr<const Poly<Mod>> root_table(std::size_t len, const bool invert) {
+    len = std::max<std::size_t>(len, 2);
+    if (len & (len - 1) || (Mod - 1) % static_cast<i64>(len)) {
+        throw std::invalid_argument("poly: transform length is not a power of two dividing Mod - 1");
+    }
+    static std::mutex lock;
+    static std::shared_ptr<const Poly<Mod>> cache[2];
+    const std::lock_guard<std::mutex> guard(lock);
+    std::shared_ptr<const Poly<Mod>>& rt = cache[invert];
+    if (!rt || rt->size() < len) rt = std::make_shared<const Poly<Mod>>(build_roots<Mod>(len, invert));
+    return rt;
+}
+
+// blocks from this length on go through the field_vector.h butterflies
+constexpr std::size_t butterfly_cutoff = 8;
+
+// decimation in frequency, natural order in, bit-reversed order out
+template <i64 Mod>
+void dif(Poly<Mod>& a, const Poly<Mod>& rt) {
+    const std::size_t len = a.size();
+    for (std::size_t h = len / 2; h >= 1; h /= 2) {
+        for (std::size_t i = 0; i < len; i += 2 * h) {
+            if (h >= butterfly_cutoff) {
+                fv_dif(&a[i], &a[i + h], &rt[h], h);
+                continue;
+            }
+            for (std::size_t j = 0; j < h; ++j) {
+                const Field<Mod> u = a[i + j], v = a[i + j + h];
+                a[i + j] = u + v;
+                a[i + j + h] = (u - v) * rt[h + j];
+            }
+        }
+    }
+}
+
+// decimation in time, bit-reversed order in, natural order out, unscaled
+template <i64 Mod>
+void dit(Poly<Mod>& a, const Poly<Mod>& irt) {
+    const std::size_t len = a.size();
+    for (std::size_t h = 1; h < len; h *= 2) {
+        for (std::size_t i = 0; i < len; i += 2 * h) {
+            if (h >= butterfly_cutoff) {
+                fv_dit(&a[i], &a[i + h], &irt[h], h);
+                continue;
+            }
+            for (std::size_t j = 0; j < h; ++j) {
+                const Field<Mod> u = a[i + j], v = a[i + j + h] * irt[h + j];
+                a[i + j] = u + v;
+                a[i + j + h] = u - v;
+            }
+        }
+    }
+}
+
+template <i64 Mod>
+void scale(Poly<Mod>& a, const std::size_t len) {
+    fv_scale(a.data(), a.data(), Field<Mod>(static_cast<i64>(len)).inv(), a.size());
+}
+
+inline std::size_t ceil_pow2(const std::size_t n) {
+    std::size_t len = 1;
+    while (len < n) len <<= 1;
+    return len;
+}
+
+template <i64 Mod>
+void trim(Poly<Mod>& a) {
+    while (!a.empty() && !a.back()) a.pop_back();
+}
+
+template <i64 Mod>
+Poly<Mod> mul_naive(const Poly<Mod>& a, const Poly<Mod>& b) {
+    Poly<Mod> r(a.size() + b.size() - 1);
+    for (std::size_t i = 0; i < a.size(); ++i) fv_axpy(&r[i], a[i], b.data(), b.size());
+    return r;
+}
+
+/* Schoolbook division, b trimmed and non-empty */
+template <i64 Mod>
+std::pair<Poly<Mod>, Poly<Mod>> divmod_naive(Poly<Mod> a, const Poly<Mod>& b) {
+    const std::size_t m = b.size();
+    Poly<Mod> q(a.size() - m + 1);
+    const Field<Mod> lead_inv = b.back().inv();
+    for (std::size_t i = q.size(); i-- > 0;) {
+        q[i] = a[i + m - 1] * lead_inv;
+        if (q[i]) fv_axpy(&a[i], -q[i], b.data(), m);
+    }
+    a.resize(m - 1);
+    trim(a);
+    return {q, a};
+}
+
+/* Product tree over the points, node v covers [l, r) and holds
+ * prod (X - x_i) for i in [l, r); children 2v and 2v + 1.
+ */
+template <i64 Mod>
+struct subproduct_tree {
+    std::vector<Poly<Mod>> node;
+
+    explicit subproduct_tree(const std::vector<Field<Mod>>& x) : node(4 * std::max<std::size_t>(x.size(), 1)) {
+        if (!x.empty()) build(x, 1, 0, x.size());
+    }
+
+    void build(const std::vector<Field<Mod>>& x, const std::size_t v, const std::size_t l, const std::size_t r) {
+        if (r - l == 1) {
+            node[v] = {-x[l], Field<Mod>(1)};
+            return;
+        }
+        const std::size_t mid = (l + r) / 2;
+        build(x, 2 * v, l, mid);
+        build(x, 2 * v + 1, mid, r);
+        node[v] = poly_mul(node[2 * v], node[2 * v + 1]);
+    }
+};
+
+template <i64 Mod>
+Poly<Mod> mod(const Poly<Mod>& a, const Poly<Mod>& b) {
+    if (a.size() < b.size()) return a;
+    return poly_divmod(a, b).second;
+}
+
+template <i64 Mod>
+Field<Mod> horner(const Poly<Mod>& a, const Field<Mod> x) {
+    Field<Mod> r = 0;
+    for (std::size_t i = a.size(); i-- > 0;) r = r * x + a[i];
+    return r;
+}
+
+template <i64 Mod>
+void eval_tree(const subproduct_tree<Mod>& t, const Poly<Mod>& a, const std::vector<Field<Mod>>& x,
+               std::vector<Field<Mod>>& out, const std::size_t v, const std::size_t l, const std::size_t r) {
+    if (r - l <= eval_cutoff) {
+        for (std::size_t i = l; i < r; ++i) out[i] = horner(a, x[i]);
+        return;
+    }
+    const std::size_t mid = (l + r) / 2;
+    eval_tree(t, mod(a, t.node[2 * v]), x, out, 2 * v, l, mid);
+    eval_tree(t, mod(a, t.node[2 * v + 1]), x, out, 2 * v + 1, mid, r);
+}
+
+// sum of w_i * prod_{j != i} (X - x_j) over [l, r)
+template <i64 Mod>
+Poly<Mod> combine(const subproduct_tree<Mod>& t, const std::vector<Field<Mod>>& w,
+                  const std::size_t v, const std::size_t l, const std::size_t r) {
+    if (r - l == 1) return {w[l]};
+    const std::size_t mid = (l + r) / 2;
+    Poly<Mod> lo = poly_mul(combine(t, w, 2 * v, l, mid), t.node[2 * v + 1]);
+    const Poly<Mod> hi = poly_mul(combine(t, w, 2 * v + 1, mid, r), t.node[2 * v]);
+    if (lo.size() < hi.size()) lo.resize(hi.size());
+    fv_add(lo.data(), lo.data(), hi.data(), hi.size());
+    return lo;
+}
+
+} // namespace poly_detail
+
+/* Number-theoretic transform
+ * a.size() has to be a power of two dividing Mod - 1, std::invalid_argument
+ * otherwise. The output is in bit-reversed order, which intt takes back;
+ * pointwise products in between are cyclic convolutions.
+ */
+template <i64 Mod>
+void ntt(Poly<Mod>& a) {
+    if (a.size() > 1) poly_detail::dif(a, *poly_detail::root_table<Mod>(a.size(), false));
+}
+
+template <i64 Mod>
+void intt(Poly<Mod>& a) {
+    if (a.size() > 1) poly_detail::dit(a, *poly_detail::root_table<Mod>(a.size(), true));
+    poly_detail::scale(a, a.size());
+}
+
+/* Polynomial multiplication
+ * O(n log n) by transforms above a small size, schoolbook below
+ */
+template <i64 Mod>
+Poly<Mod> poly_mul(const Poly<Mod>& a, const Poly<Mod>& b) {
+    using namespace poly_detail;
+    if (a.empty() || b.empty()) return {};
+    if (std::min(a.size(), b.size()) <= mul_cutoff) return mul_naive(a, b);
+
+    const std::size_t n = a.size() + b.size() - 1, len = ceil_pow2(n);
+    const auto rt = root_table<Mod>(len, false);
+    Poly<Mod> fa(a);
+    fa.resize(len);
+    dif(fa, *rt);
+    if (&a == &b) {
+        fv_mul(fa.data(), fa.data(), fa.data(), len);
+    }
+    else {
+        Poly<Mod> fb(b);
+        fb.resize(len);
+        dif(fb, *rt);
+        fv_mul(fa.data(), fa.data(), fb.data(), len);
+    }
+    dit(fa, *root_table<Mod>(len, true));
+    fa.resize(n);
+    scale(fa, len);
+    return fa;
+}
+
+/* Power series inverse, the first n terms of 1 / a
+ * Newton iteration b <- b - b (a b - 1), doubling the precision with four
+ * transforms of twice its length per step. a[0] != 0.
+ */
+template <i64 Mod>
+Poly<Mod> poly_inv(const Poly<Mod>& a, const std::size_t n) {
+    using namespace poly_detail;
+    if (a.empty() || !a[0]) throw std::domain_error("poly_inv: constant term is zero");
+    // the longest transform is 2m <= ceil_pow2(n)
+    const auto rt_ptr = root_table<Mod>(ceil_pow2(n), false), irt_ptr = root_table<Mod>(ceil_pow2(n), true);
+    const Poly<Mod>& rt = *rt_ptr;
+    const Poly<Mod>& irt = *irt_ptr;
+
+    Poly<Mod> b{a[0].inv()};
+    for (std::size_t m = 1; m < n; m *= 2) {
+        Poly<Mod> f(a.begin(), a.begin() + std::min(a.size(), 2 * m));
+        Poly<Mod> g(b);
+        f.resize(2 * m);
+        g.resize(2 * m);
+        dif(f, rt);
+        dif(g, rt);
+        fv_mul(f.data(), f.data(), g.data(), 2 * m);
+        dit(f, irt);
+        scale(f, 2 * m);
+        // a b = 1 + O(X^m), keep the terms that need correcting
+        std::fill(f.begin(), f.begin() + m, Field<Mod>(0));
+        dif(f, rt);
+        fv_mul(f.data(), f.data(), g.data(), 2 * m);
+        dit(f, irt);
+        scale(f, 2 * m);
+        b.resize(2 * m);
+        for (std::size_t i = m; i < 2 * m; ++i) b[i] = -f[i];
+    }
+    b.resize(n);
+    return b;
+}
+
+/* Polynomial division, a = q b + r with deg r < deg b
+ * The reversed quotient is rev(a) / rev(b) as power series. Returns {q, r}
+ * without trailing zero coefficients.
+ */
+template <i64 Mod>
+std::pair<Poly<Mod>, Poly<Mod>> poly_divmod(const Poly<Mod>& a, const Poly<Mod>& b) {
+    using namespace poly_detail;
+    Poly<Mod> x(a), y(b);
+    trim(x);
+    trim(y);
+    if (y.empty()) throw std::domain_error("poly_divmod: division by zero");
+    if (x.size() < y.size()) return {{}, x};
+    const std::size_t k = x.size() - y.size() + 1;
+    if (std::min(k, y.size()) <= div_cutoff) return divmod_naive(std::move(x), y);
+
+    Poly<Mod> ra(x.rbegin(), x.rbegin() + k), rb(y.rbegin(), y.rend());
+    Poly<Mod> q = poly_mul(ra, poly_inv(rb, k));
+    q.resize(k);
+    std::reverse(q.begin(), q.end());
+
+    const Poly<Mod> qb = poly_mul(q, y);
+    Poly<Mod> r(y.size() - 1);
+    for (std::size_t i = 0; i < r.size(); ++i) r[i] = x[i] - qb[i];
+    trim(r);
+    return {q, r};
+}
+
+/* Multipoint evaluation, a(x_i) for every point
+ * Remainders down a subproduct tree, O(n log^2 n)
+ */
+template <i64 Mod>
+std::vector<Field<Mod>> poly_eval(const Poly<Mod>& a, const std::vector<Field<Mod>>& x) {
+    using namespace poly_detail;
+    std::vector<Field<Mod>> out(x.size());
+    if (x.empty()) return out;
+    if (x.size() <= eval_cutoff) {
+        for (std::size_t i = 0; i < x.size(); ++i) out[i] = horner(a, x[i]);
+        return out;
+    }
+    const subproduct_tree<Mod> t(x);
+    eval_tree(t, mod(a, t.node[1]), x, out, 1, 0, x.size());
+    return out;
+}
+
+/* Lagrange interpolation, the polynomial of degree < n through (x_i, y_i)
+ * The points have to be distinct. With P = prod (X - x_i) the weights are
+ * y_i / P'(x_i), combined up the subproduct tree, O(n log^2 n).
+ */
+template <i64 Mod>
+Poly<Mod> poly_interpolate(const std::vector<Field<Mod>>& x, const std::vector<Field<Mod>>& y) {
+    using namespace poly_detail;
+    if (x.size() != y.size()) throw std::invalid_argument("poly_interpolate: x and y differ in size");
+    if (x.empty()) return {};
+    const subproduct_tree<Mod> t(x);
+    const Poly<Mod>& p = t.node[1];
+    Poly<Mod> dp(p.size() - 1);
+    for (std::size_t i = 1; i < p.size(); ++i) dp[i - 1] = p[i] * static_cast<i64>(i);
+
+    std::vector<Field<Mod>> w(x.size());
+    if (x.size() <= eval_cutoff) {
+        for (std::size_t i = 0; i < x.size(); ++i) w[i] = horner(dp, x[i]);
+    }
+    else {
+        eval_tree(t, dp, x, w, 1, 0, x.size());
+    }
+    fv_inv(w.data(), w.data(), w.size());
+    fv_mul(w.data(), w.data(), y.data(), w.size());
+    Poly<Mod> r = combine(t, w, 1, 0, x.size());
+    trim(r);
+    return r;
+}
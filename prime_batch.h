@@ -0,0 +1,310 @@
+#pragma once
+#include "primes_t.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Batch primality testing
+   out[i] = is_prime(n[i]) for i < count, for large arrays of unrelated
+   candidates. A block of candidates is first checked for odd prime factors
+   up to 251 with SIMD divisibility tests (AVX-512 or AVX2 when the CPU
+   supports them). The survivors take the same deterministic tests as
+   is_prime, but lanes candidates at a time: every lane has its own
+   Montgomery64 modulus and exponent, and the lanes run one bit in step, so
+   the multiplier latency of one chain overlaps with the others. Blocks are
+   spread over prime_batch_threads threads.
+   */
+
+inline unsigned prime_batch_threads = 1;
+
+inline void is_prime_batch(const u64* n, bool* out, std::size_t count);
+
+namespace prime_batch_detail {
+
+constexpr int lanes = 8;
+constexpr std::size_t block = 4096;  // candidates per task
+
+/* n * inv <= lim iff p | n, see primes_detail::divisor; one array each so
+   the SIMD kernels broadcast straight from them */
+constexpr int filter_count = 53;  // odd primes up to 251
+
+struct filter_table {
+    u64 inv[filter_count], lim[filter_count];
+};
+
+constexpr filter_table make_filter() {
+    filter_table t{};
+    int i = 0;
+    for (u64 p = 3; i < filter_count; p += 2) {
+        if (!(primes_detail::small_primes.bits[p >> 7] >> (p >> 1 & 63) & 1)) continue;
+        u64 inv = p;
+        for (int j = 0; j < 5; ++j) inv *= 2 - p * inv;
+        t.inv[i] = inv;
+        t.lim[i++] = ~u64(0) / p;
+    }
+    return t;
+}
+
+inline constexpr filter_table filter = make_filter();
+
+/* keep[i] = 1 if n[i] has no odd prime factor up to 251 */
+inline void filter_scalar(const u64* n, u8* keep, const std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        bool k = true;
+        for (int j = 0; j < filter_count; ++j) k &= n[i] * filter.inv[j] > filter.lim[j];
+        keep[i] = k;
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx512f,avx512dq")))
+inline void filter_avx512(const u64* n, u8* keep, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m512i x = _mm512_loadu_si512(n + i);
+        __mmask8 k = 0xff;
+        for (int j = 0; j < filter_count; ++j) {
+            const __m512i q = _mm512_mullo_epi64(x, _mm512_set1_epi64(filter.inv[j]));
+            k &= _mm512_cmpgt_epu64_mask(q, _mm512_set1_epi64(filter.lim[j]));
+        }
+        for (int l = 0; l < 8; ++l) keep[i + l] = k >> l & 1;
+    }
+    filter_scalar(n + i, keep + i, count - i);
+}
+
+/* low half of a * b, b split into 32-bit halves ahead */
+__attribute__((target("avx2")))
+inline __m256i mullo_avx2(const __m256i a, const __m256i b, const __m256i b_hi) {
+    const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, b_hi));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+inline void filter_avx2(const u64* n, u8* keep, const std::size_t count) {
+    // unsigned compare as signed, with the sign bits flipped
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(u64(1) << 63));
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(n + i));
+        __m256i k = _mm256_set1_epi64x(-1);
+        for (int j = 0; j < filter_count; ++j) {
+            const __m256i inv = _mm256_set1_epi64x(static_cast<long long>(filter.inv[j]));
+            const __m256i q = mullo_avx2(x, inv, _mm256_srli_epi64(inv, 32));
+            const __m256i lim = _mm256_set1_epi64x(static_cast<long long>(filter.lim[j] ^ (u64(1) << 63)));
+            k = _mm256_and_si256(k, _mm256_cmpgt_epi64(_mm256_xor_si256(q, sign), lim));
+        }
+        const int m = _mm256_movemask_pd(_mm256_castsi256_pd(k));
+        for (int l = 0; l < 4; ++l) keep[i + l] = m >> l & 1;
+    }
+    filter_scalar(n + i, keep + i, count - i);
+}
+
+#endif
+
+enum class isa { scalar, avx2, avx512 };
+
+inline isa select() {
+#if defined(__x86_64__)
+    static const isa best = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") ? isa::avx512
+                            : __builtin_cpu_supports("avx2")                                         ? isa::avx2
+                                                                                                      : isa::scalar;
+    return best;
+#else
+    return isa::scalar;
+#endif
+}
+
+inline void small_factor_filter(const u64* n, u8* keep, const std::size_t count) {
+    switch (select()) {
+#if defined(__x86_64__)
+        case isa::avx512: return filter_avx512(n, keep, count);
+        case isa::avx2: return filter_avx2(n, keep, count);
+#endif
+        default: return filter_scalar(n, keep, count);
+    }
+}
+
+/* mask ? a : b for mask all ones or all zeros. The exponent bits differ
+   from lane to lane, so a branch on them would be mispredicted half the
+   time. */
+inline u64 pick(const u64 mask, const u64 a, const u64 b) {
+    return b ^ ((a ^ b) & mask);
+}
+
+/* One candidate of the test stages: its modulus, n - 1 = d 2^s and the
+   base a for Miller-Rabin, or n + 1 = d 2^s and a = Q for Lucas, a in
+   Montgomery form */
+struct candidate {
+    Montgomery64 m;
+    u64 d;
+    int s;
+    u64 a;
+    std::size_t i;  // index into the block
+};
+
+/* Montgomery64 arithmetic with the constants of each lane held in plain
+   arrays, so the lane loops keep them in registers or on the stack instead
+   of reloading them through the candidates */
+struct lane_group {
+    u64 n[lanes], ninv[lanes], one[lanes], d[lanes], a[lanes], dall = 0;
+    int s[lanes], smax = 0;
+
+    /* c[0..k), the last lanes repeating c[0] */
+    lane_group(const candidate* c, const std::size_t k) {
+        for (std::size_t l = 0; l < lanes; ++l) {
+            const candidate& x = c[l < k ? l : 0];
+            n[l] = x.m.mod();
+            ninv[l] = n[l];
+            for (int i = 0; i < 5; ++i) ninv[l] *= 2 - n[l] * ninv[l];
+            one[l] = x.m.one();
+            d[l] = x.d;
+            s[l] = x.s;
+            a[l] = x.a;
+            dall |= d[l];
+            smax = std::max(smax, s[l]);
+        }
+    }
+
+    u64 mul(const int l, const u64 a, const u64 b) const {
+        const u128 t = static_cast<u128>(a) * b;
+        const u64 m = static_cast<u64>(t) * ninv[l];
+        const u64 mn = static_cast<u128>(m) * n[l] >> 64;
+        const u64 hi = t >> 64;
+        return hi < mn ? hi - mn + n[l] : hi - mn;
+    }
+
+    u64 add(const int l, const u64 a, const u64 b) const {
+        const u64 s = a - (n[l] - b);
+        return a < n[l] - b ? s + n[l] : s;
+    }
+
+    u64 sub(const int l, const u64 a, const u64 b) const { return a < b ? a - b + n[l] : a - b; }
+};
+
+/* Strong probable prime tests for a group, to base 2 or to the bases
+   g.a. Exponents are scanned from the top bit of the
+   longest one; shorter ones start at 1 and stay there.
+   */
+inline void strong_test_lanes(const lane_group& g, const bool two, bool* res) {
+    u64 x[lanes];
+    for (int l = 0; l < lanes; ++l) x[l] = g.one[l];
+    for (int b = 63 - __builtin_clzll(g.dall); b >= 0; --b) {
+        for (int l = 0; l < lanes; ++l) {
+            const u64 sq = g.mul(l, x[l], x[l]), bit = 0 - (g.d[l] >> b & 1);
+            x[l] = two ? pick(bit, g.add(l, sq, sq), sq) : g.mul(l, sq, pick(bit, g.a[l], g.one[l]));
+        }
+    }
+    bool pass[lanes];
+    for (int l = 0; l < lanes; ++l) pass[l] = x[l] == g.one[l] || x[l] == g.n[l] - g.one[l];
+    for (int r = 1; r < g.smax; ++r) {
+        for (int l = 0; l < lanes; ++l) {
+            x[l] = g.mul(l, x[l], x[l]);
+            pass[l] |= r < g.s[l] && x[l] == g.n[l] - g.one[l];
+        }
+    }
+    for (int l = 0; l < lanes; ++l) res[l] = pass[l];
+}
+
+/* Strong Lucas tests for a group with P = 1 and Q = g.a: the ladder of primes_detail::strong_lucas_probable_prime, started
+   from k = 0 with V_0 = 2, V_1 = 1, Q^0 = 1 and Q^1 = Q.
+   */
+inline void lucas_test_lanes(const lane_group& g, bool* res) {
+    u64 v[lanes], w[lanes], qa[lanes], qb[lanes];
+    for (int l = 0; l < lanes; ++l) {
+        w[l] = qa[l] = g.one[l];
+        v[l] = g.add(l, w[l], w[l]);
+        qb[l] = g.a[l];
+    }
+    for (int b = 63 - __builtin_clzll(g.dall); b >= 0; --b) {
+        for (int l = 0; l < lanes; ++l) {
+            const u64 bit = 0 - (g.d[l] >> b & 1);
+            const u64 x = pick(bit, w[l], v[l]), y = pick(bit, qb[l], qa[l]);
+            const u64 vw = g.sub(l, g.mul(l, v[l], w[l]), qa[l]);
+            const u64 sq = g.sub(l, g.mul(l, x, x), g.add(l, y, y));
+            const u64 qab = g.mul(l, qa[l], qb[l]), qq = g.mul(l, y, y);
+            v[l] = pick(bit, vw, sq);
+            w[l] = pick(bit, sq, vw);
+            qa[l] = pick(bit, qab, qq);
+            qb[l] = pick(bit, qq, qab);
+        }
+    }
+    bool pass[lanes];
+    for (int l = 0; l < lanes; ++l) pass[l] = v[l] == 0 || g.add(l, w[l], w[l]) == v[l];
+    for (int r = 1; r < g.smax; ++r) {
+        for (int l = 0; l < lanes; ++l) {
+            v[l] = g.sub(l, g.mul(l, v[l], v[l]), g.add(l, qa[l], qa[l]));
+            qa[l] = g.mul(l, qa[l], qa[l]);
+            pass[l] |= r < g.s[l] && v[l] == 0;
+        }
+    }
+    for (int l = 0; l < lanes; ++l) res[l] = pass[l];
+}
+
+/* Runs test on all of cs, lanes at a time, and keeps the ones that pass */
+template <typename F>
+void run_lanes(std::vector<candidate>& cs, F test) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < cs.size(); i += lanes) {
+        const std::size_t k = std::min<std::size_t>(lanes, cs.size() - i);
+        bool res[lanes];
+        test(lane_group(&cs[i], k), res);
+        for (std::size_t l = 0; l < k; ++l) {
+            if (res[l]) cs[kept++] = cs[i + l];
+        }
+    }
+    cs.erase(cs.begin() + kept, cs.end());
+}
+
+inline void test_block(const u64* n, bool* out, const std::size_t count) {
+    using namespace primes_detail;
+    std::vector<u8> keep(count);
+    small_factor_filter(n, keep.data(), count);
+
+    std::vector<candidate> cs;
+    for (std::size_t i = 0; i < count; ++i) {
+        const u64 x = n[i];
+        out[i] = false;
+        if (x < small_limit) {
+            out[i] = x == 2 || (x & 1 && small_primes.bits[x >> 7] >> (x >> 1 & 63) & 1);
+        } else if (x & 1 && keep[i]) {
+            const int s = __builtin_ctzll(x - 1);
+            cs.push_back({Montgomery64(x), (x - 1) >> s, s, 0, i});
+        }
+    }
+    run_lanes(cs, [](const lane_group& g, bool* res) { strong_test_lanes(g, true, res); });
+
+    // second rounds: a hashed base below 2^32, Lucas above
+    std::vector<candidate> lucas;
+    std::size_t small = 0;
+    for (candidate& c: cs) {
+        const u64 x = c.m.mod();
+        if (x >> 32 == 0) {
+            c.a = c.m.to(base32(x));
+            cs[small++] = c;
+            continue;
+        }
+        const u64 q = selfridge_q(c.m, x);
+        const int s = __builtin_ctzll(x + 1);
+        if (q) lucas.push_back({c.m, (x + 1) >> s, s, q, c.i});
+    }
+    cs.erase(cs.begin() + small, cs.end());
+    run_lanes(cs, [](const lane_group& g, bool* res) { strong_test_lanes(g, false, res); });
+    run_lanes(lucas, [](const lane_group& g, bool* res) { lucas_test_lanes(g, res); });
+    for (const candidate& c: cs) out[c.i] = true;
+    for (const candidate& c: lucas) out[c.i] = true;
+}
+
+} // namespace prime_batch_detail
+
+inline void is_prime_batch(const u64* n, bool* out, const std::size_t count) {
+    using namespace prime_batch_detail;
+    const std::size_t tasks = (count + block - 1) / block;
+    sieve_detail::parallel_for(tasks, prime_batch_threads, [&](const std::size_t t) {
+        const std::size_t lo = t * block;
+        test_block(n + lo, out + lo, std::min(block, count - lo));
+    });
+}
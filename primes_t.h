@@ -1,6 +1,7 @@
 #pragma once
 #include "mod_a_t.h"
 #include "misc_al_t.h"
+#include "sieve.h"
 #include <iterator>
 #include <algorithm>
 #include <vector>
@@ -52,66 +53,14 @@ std::vector<T> gen_primes(T lim) {
     return segmented_sieve(lim);
 }
 
-/* Segmented sieve of Eratosthenes with a small wheel.
- * Based on Kim Walisch's code at
- * https://github.com/kimwalisch/primesieve/wiki/Segmented-sieve-of-Eratosthenes
+/* Segmented sieve of Eratosthenes
+ * All primes up to lim, from the bit-packed mod-30 sieve in sieve.h, on
+ * sieve_threads threads.
  */
-
 template <typename T>
 std::vector<T> segmented_sieve(T lim) {
     if (lim < 2) return std::vector<T>{};
-    if (lim < 3) return std::vector<T>{2};
-    if (lim < 5) return std::vector<T>{2, 3};
-
-    constexpr int segment_size = 524288; // L2 cache size
-    T sqrt_lim = isqrt(lim);
-
-    std::vector<u8> is_prime(sqrt_lim + 1, true);
-    std::vector<u8> sieve(segment_size);
-    std::vector<T> sieve_primes = {};
-    std::vector<T> multiples = {};
-
-    std::vector<T> primes(T(1.26 * (lim / log(lim))) + 1);
-    primes[0] = 2; primes[1] = 3; primes[2] = 5;
-
-    T a = 3;
-    T n = 7;
-    T pc = 3; // # of primes
-
-    // 2*3*5 sieving wheel
-    u8 o = 0;
-    constexpr u8 offset[] = {4, 2, 4, 2, 4, 6, 2, 6};
-
-    for (T low = 0; low <= lim; low += segment_size) {
-        std::fill(sieve.begin(), sieve.end(), true);
-        T high = low + segment_size - 1;
-        high = std::min(high, lim);
-
-        while (a * a <= high) {
-            if (is_prime[a]) {
-                sieve_primes.emplace_back(a);
-                multiples.emplace_back(a * a - low);
-                for (T b = a * a; b <= sqrt_lim; b += a) {
-                    is_prime[b] = false;
-                }
-            }
-            a += 2;
-        }
-
-        for (int i = 0; i < sieve_primes.size(); ++i) {
-            T j = multiples[i];
-            for (T k = 2 * sieve_primes[i]; j < segment_size; j += k) sieve[j] = false;
-            multiples[i] = j - segment_size;
-        }
-
-        while (n <= high) {
-            if (sieve[n - low]) primes[pc++] = n;
-            n += offset[o++];
-            o &= 0x7;
-        }
-    }
-    if (primes.size() > pc) primes.resize(pc);
-    return primes;
+    return primes_in_range<T>(0, lim);
 }
 
 /* Wheel Factorization.
@@ -258,19 +207,191 @@ std::vector<T> factorise(T n) {
     return factors;
 }
 
+namespace primes_detail {
+
+// is_prime answers below this from a bitmap
+constexpr u64 small_limit = u64(1) << 16;
+
+/* Odd primes below small_limit, bit n / 2 */
+struct small_bitmap {
+    u64 bits[small_limit / 128];
+};
+
+constexpr small_bitmap make_small_bitmap() {
+    small_bitmap t{};
+    for (auto& w: t.bits) w = ~u64(0);
+    t.bits[0] &= ~u64(1);
+    for (u64 p = 3; p * p < small_limit; p += 2) {
+        if (!(t.bits[p >> 7] >> (p >> 1 & 63) & 1)) continue;
+        for (u64 m = p * p; m < small_limit; m += 2 * p) t.bits[m >> 7] &= ~(u64(1) << (m >> 1 & 63));
+    }
+    return t;
+}
+
+inline constexpr small_bitmap small_primes = make_small_bitmap();
+
+/* p divides n iff n * p^-1 mod 2^64 <= (2^64 - 1) / p, one multiplication
+ * instead of a division
+ */
+struct divisor {
+    u64 inv, lim;
+};
+
+constexpr u32 trial_primes[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+constexpr int trial_count = sizeof(trial_primes) / sizeof(trial_primes[0]);
+
+struct divisor_table {
+    divisor d[trial_count];
+};
+
+constexpr divisor_table make_divisors() {
+    divisor_table t{};
+    for (int i = 0; i < trial_count; ++i) {
+        const u64 p = trial_primes[i];
+        u64 inv = p;
+        for (int j = 0; j < 5; ++j) inv *= 2 - p * inv;
+        t.d[i] = {inv, ~u64(0) / p};
+    }
+    return t;
+}
+
+inline constexpr divisor_table divisors = make_divisors();
+
+inline bool has_small_factor(const u64 n) {
+    for (const divisor& d: divisors.d) {
+        if (n * d.inv <= d.lim) return true;
+    }
+    return false;
+}
+
+/* Second bases for odd n in [2^16, 2^32) that pass base 2, by hash of n.
+ * Each one rules out every strong pseudoprime to base 2 in its bucket, so
+ * the two rounds are deterministic.
+ */
+constexpr int base32_bits = 5;
+constexpr u8 base32_table[] = {34, 33, 17, 15, 13, 45, 59, 163, 15, 15, 7, 33, 21, 53, 7, 59,
+                               83, 15, 11, 35, 15, 106, 15, 39, 110, 33, 38, 30, 30, 38, 7, 17};
+
+inline u64 base32(const u64 n) {
+    return base32_table[static_cast<u32>(n) * 0x9e3779b1u >> (32 - base32_bits)];
+}
+
+// Deterministic for n < 2^64 (Sinclair)
+constexpr u64 mr_bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+/* Strong probable prime test to base a, a in Montgomery form,
+ * n - 1 = d 2^s with d odd
+ */
+inline bool strong_probable_prime(const Montgomery64& m, const u64 a, const u64 d, const int s) {
+    const u64 one = m.one(), minus_one = m.mod() - one;
+    u64 x = m.pow(a, d);
+    if (x == one || x == minus_one) return true;
+    for (int i = 1; i < s; ++i) {
+        x = m.mul(x, x);
+        if (x == minus_one) return true;
+        if (x == one) return false;
+    }
+    return false;
+}
+
+/* Jacobi symbol (a / n), n odd */
+inline int jacobi(u64 a, u64 n) {
+    int t = 1;
+    a %= n;
+    while (a) {
+        const int z = __builtin_ctzll(a);
+        a >>= z;
+        if (z & 1 && ((n & 7) == 3 || (n & 7) == 5)) t = -t;
+        if ((a & 3) == 3 && (n & 3) == 3) t = -t;
+        std::swap(a, n);
+        a %= n;
+    }
+    return n == 1 ? t : 0;
+}
+
+/* Selfridge's parameters for the strong Lucas test: the first D of
+ * 5, -7, 9, -11, ... with (D / n) = -1, P = 1 and Q = (1 - D) / 4.
+ * Returns Q in Montgomery form, or 0 when the search finds n composite.
+ * n odd and above the trial primes.
+ */
+inline u64 selfridge_q(const Montgomery64& m, const u64 n) {
+    u64 abs_d = 5;
+    bool neg = false;
+    for (;; abs_d += 2, neg = !neg) {
+        const int j = jacobi(neg ? n - abs_d % n : abs_d, n);
+        if (j == -1) break;
+        if (j == 0 && abs_d % n) return 0;
+        // no D is ever found for squares
+        if (abs_d == 13 && sieve_detail::isqrt(n) * sieve_detail::isqrt(n) == n) return 0;
+    }
+    return neg ? m.to((abs_d + 1) / 4) : n - m.to((abs_d - 1) / 4);
+}
+
+/* Strong Lucas probable prime test with Selfridge's parameters,
+ * n odd, above the trial primes and below 2^64 - 1
+ */
+inline bool strong_lucas_probable_prime(const Montgomery64& m, const u64 n) {
+    const u64 qm = selfridge_q(m, n);
+    if (!qm) return false;
+    const u64 one = m.one();
+
+    // V_k, V_{k+1}, Q^k and Q^(k+1) for the leading bits k of d, n + 1 = d 2^s.
+    // The four products of a step are independent, and the bit only selects.
+    const int s = __builtin_ctzll(n + 1);
+    const u64 d = (n + 1) >> s;
+    u64 v = one, w = m.sub(one, m.add(qm, qm)), qa = qm, qb = m.mul(qm, qm);
+    for (int i = 62 - __builtin_clzll(d); i >= 0; --i) {
+        const bool bit = d >> i & 1;
+        const u64 x = bit ? w : v, y = bit ? qb : qa;
+        const u64 vw = m.sub(m.mul(v, w), qa), sq = m.sub(m.mul(x, x), m.add(y, y));
+        const u64 qab = m.mul(qa, qb), qq = m.mul(y, y);
+        v = bit ? vw : sq;
+        w = bit ? sq : vw;
+        qa = bit ? qab : qq;
+        qb = bit ? qq : qab;
+    }
+    u64 qk = qa;
+    // D U_d = 2 V_{d+1} - V_d
+    if (v == 0 || m.add(w, w) == v) return true;
+    for (int r = 1; r < s; ++r) {
+        v = m.sub(m.mul(v, v), m.add(qk, qk));
+        if (v == 0) return true;
+        qk = m.mul(qk, qk);
+    }
+    return false;
+}
+
+}  // namespace primes_detail
+
+/* Primality test, deterministic for n < 2^64
+   Below 2^16 a bitmap lookup. Above it, trial division by the primes up to
+   53, then a strong test to base 2 in Montgomery form, followed by a second
+   base picked by hash for 32-bit n and by a strong Lucas test (Baillie-PSW)
+   otherwise. Baillie-PSW has no counterexample below 2^64.
+   */
 template <typename T>
 bool is_prime(T n) {
+    using namespace primes_detail;
     if (n < 2) {
         return false;
     }
-    if (n < 321503171) {
-        return trial_div(n);
+    const u64 x = static_cast<u64>(n);
+    if (x < small_limit) {
+        return x == 2 || (x & 1 && small_primes.bits[x >> 7] >> (x >> 1 & 63) & 1);
+    }
+    if (!(x & 1) || has_small_factor(x)) {
+        return false;
     }
-    if (n % 2 == 0 || n % 3 == 0 || n % 5 == 0 || n % 7 == 0 ||
-        n % 11 == 0 || n % 13 == 0 || n % 17 == 0 || n % 19 == 0) {
+    const Montgomery64 m(x);
+    const int s = __builtin_ctzll(x - 1);
+    const u64 d = (x - 1) >> s;
+    if (!strong_probable_prime(m, m.add(m.one(), m.one()), d, s)) {
         return false;
     }
-    return miller_rabin(n);
+    if (x >> 32 == 0) {
+        return strong_probable_prime(m, m.to(base32(x)), d, s);
+    }
+    return strong_lucas_probable_prime(m, x);
 }
 
 /* Simple primality test
@@ -304,48 +425,31 @@ bool trial_div(T n) {
 }
 
 /* Miller-Rabin
-   Works if n < 2^64
+   Works if n < 2^64, with the seven bases of primes_detail::mr_bases
    */
 template <typename T>
 bool miller_rabin(T n) {
-    if (!(n & 1) || n < 2) {
-        return false;
-    }
-    T d = n - 1;
-    int r = 0;
-    while (!(d & 1)) {
-        ++r;
-        d >>= 1;
+    if (n < 2 || !(n & 1)) {
+        return n == 2;
     }
-
-    std::vector<T> arr = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
-
-    for (auto a: arr) {
-        if (n == a) {
-            return true;
-        }
-        else if (mr_is_composite(n, d, r, a)) {
+    const u64 x = static_cast<u64>(n);
+    const Montgomery64 m(x);
+    const int s = __builtin_ctzll(x - 1);
+    const u64 d = (x - 1) >> s;
+    for (const u64 a: primes_detail::mr_bases) {
+        const u64 b = a % x;
+        if (b && !primes_detail::strong_probable_prime(m, m.to(b), d, s)) {
             return false;
         }
     }
-
     return true;
 }
 
+/* n - 1 = d 2^r, n odd */
 template <typename T>
 bool mr_is_composite(T n, T d, int r, T a) {
-    T x = mod_exp(a, d, n);
-    if (x == 1 || x == n - 1) {
-        return false;
-    }
-    for (int i = 1; i < r; ++i) {
-        x = mod_exp<T>(x, 2, n);
-        if (x == n - 1) {
-            return false;
-        }
-    }
-
-    return true;
+    const Montgomery64 m(static_cast<u64>(n));
+    return !primes_detail::strong_probable_prime(m, m.to(static_cast<u64>(a)), static_cast<u64>(d), r);
 }
 
 template <typename T>
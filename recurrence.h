@@ -0,0 +1,173 @@
+#pragma once
+#include "field.h"
+#include "poly.h"
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/* Linear recurrences over Field<Mod>
+ * s_n = c_1 s_{n-1} + c_2 s_{n-2} + ... + c_k s_{n-k}, with coef = {c_1, ..., c_k}.
+ * Terms are found by Bostan-Mori in O(M(k) log n); orders above
+ * poly_detail::mul_cutoff use transforms when Mod - 1 has a large enough
+ * power of two, see poly.h, and schoolbook products otherwise.
+ * */
+
+template <i64 Mod>
+class LinearRecurrence;
+
+template <i64 Mod>
+Poly<Mod> berlekamp_massey(const Poly<Mod>& s);
+
+template <i64 Mod>
+Field<Mod> linear_recurrence_nth(const Poly<Mod>& coef, const Poly<Mod>& init, u64 n);
+
+template <i64 Mod>
+class LinearRecurrence {
+private:
+    std::size_t k;
+    Poly<Mod> init, p, q;  // s = p / q as power series, q = 1 - sum c_i X^i
+    std::size_t len = 0;   // transform length, 0 for schoolbook steps
+    std::shared_ptr<const Poly<Mod>> rt, irt;
+    Poly<Mod> iw;
+
+    /* One halving step with schoolbook products: p and q become the
+     * even (or odd) part of p(X) q(-X) and the even part of q(X) q(-X).
+     * rev holds q(-X) reversed, so every coefficient is one dot product.
+     * All four buffers have k + 1 entries, a[k] is unused.
+     */
+    void step_naive(Poly<Mod>& a, Poly<Mod>& b, Poly<Mod>& rev, Poly<Mod>& tmp, const bool odd) const {
+        for (std::size_t i = 0; i <= k; ++i) rev[k - i] = i & 1 ? -b[i] : b[i];
+        for (std::size_t t = 0; t < k; ++t) {
+            const std::size_t j = 2 * t + odd, lo = j > k ? j - k : 0, hi = std::min(j, k - 1);
+            tmp[t] = lo <= hi ? fv_dot(&a[lo], &rev[k - j + lo], hi - lo + 1) : Field<Mod>(0);
+        }
+        a.swap(tmp);
+        for (std::size_t t = 0; t <= k; ++t) {
+            const std::size_t j = 2 * t, lo = j > k ? j - k : 0, hi = std::min(j, k);
+            tmp[t] = fv_dot(&b[lo], &rev[k - j + lo], hi - lo + 1);
+        }
+        b.swap(tmp);
+    }
+
+    /* The same step by transforms. The values at w and -w sit next to each
+     * other in the bit-reversed output, so q(-X) needs no transform of its
+     * own, and the even and odd parts come out of half-length inverse
+     * transforms. Both results carry the same factor len, which the
+     * quotient p / q never sees, so nothing is rescaled.
+     */
+    void step_ntt(Poly<Mod>& a, Poly<Mod>& b, const bool odd) const {
+        using namespace poly_detail;
+        const std::size_t half = len / 2;
+        a.resize(len);
+        b.resize(len);
+        dif(a, *rt);
+        dif(b, *rt);
+        for (std::size_t i = 0; i < half; ++i) {
+            const Field<Mod> x = b[2 * i], y = b[2 * i + 1];
+            const Field<Mod> u = a[2 * i] * y, v = a[2 * i + 1] * x;
+            a[i] = odd ? (u - v) * iw[i] : u + v;
+            b[i] = x * y;
+            b[i] += b[i];
+        }
+        a.resize(half);
+        b.resize(half);
+        dit(a, *irt);
+        dit(b, *irt);
+        a.resize(k);
+        b.resize(k + 1);
+    }
+
+public:
+    /* init holds at least the first k terms; later ones are used as given */
+    LinearRecurrence(const Poly<Mod>& coef, const Poly<Mod>& init) : k(coef.size()), init(init), q(k + 1) {
+        if (init.size() < k) throw std::invalid_argument("LinearRecurrence: fewer initial terms than the order");
+        q[0] = 1;
+        for (std::size_t i = 0; i < k; ++i) q[i + 1] = -coef[i];
+        const std::size_t n = poly_detail::ceil_pow2(2 * k + 1);
+        if (k <= poly_detail::mul_cutoff || (Mod - 1) % static_cast<i64>(n)) {
+            // p = init q mod X^k
+            p.assign(k, Field<Mod>(0));
+            for (std::size_t i = 0; i < k; ++i) fv_axpy(&p[i], init[i], q.data(), k - i);
+            return;
+        }
+        p = poly_mul(Poly<Mod>(init.begin(), init.begin() + k), q);
+        p.resize(k);
+        len = n;
+        rt = poly_detail::root_table<Mod>(len, false);
+        irt = poly_detail::root_table<Mod>(len, true);
+        // iw[i] = 1 / w^j for the point w^j at position 2i of the output
+        const std::size_t half = len / 2;
+        iw.resize(half);
+        for (std::size_t i = 0, j = 0; i < half; ++i) {
+            iw[i] = (*irt)[half + j];
+            for (std::size_t bit = half >> 1; bit; bit >>= 1) {
+                j ^= bit;
+                if (j & bit) break;
+            }
+        }
+    }
+
+    /* Recurrence of the shortest order generating the terms, by
+     * Berlekamp-Massey; 2L terms determine one of order L.
+     */
+    static LinearRecurrence from_terms(const Poly<Mod>& terms) {
+        return LinearRecurrence(berlekamp_massey(terms), terms);
+    }
+
+    std::size_t order() const noexcept { return k; }
+
+    /* The n-th term, counting from 0 */
+    Field<Mod> operator()(u64 n) const {
+        if (n < init.size()) return init[n];
+        if (!k) return 0;
+        Poly<Mod> a(p), b(q), rev(len ? 0 : k + 1), tmp(len ? 0 : k + 1);
+        if (len) {
+            a.reserve(len);
+            b.reserve(len);
+        }
+        else {
+            a.resize(k + 1);
+        }
+        for (; n; n >>= 1) {
+            if (len) step_ntt(a, b, n & 1);
+            else step_naive(a, b, rev, tmp, n & 1);
+        }
+        return a[0] / b[0];
+    }
+};
+
+/* Berlekamp-Massey
+ * Shortest coef with s_n = sum coef[i - 1] s_{n-i} for every n it covers.
+ * O(N^2) for N terms. Mod has to be a prime.
+ */
+template <i64 Mod>
+Poly<Mod> berlekamp_massey(const Poly<Mod>& s) {
+    Poly<Mod> c{1}, b{1};  // connection polynomials, current and before the last length change
+    std::size_t len = 0, shift = 1;
+    Field<Mod> last = 1;
+    for (std::size_t n = 0; n < s.size(); ++n, ++shift) {
+        Field<Mod> d = 0;
+        for (std::size_t i = 0; i <= len && i < c.size(); ++i) d += c[i] * s[n - i];
+        if (!d) continue;
+        const Poly<Mod> t = 2 * len <= n ? c : Poly<Mod>();
+        const Field<Mod> f = d / last;
+        if (c.size() < b.size() + shift) c.resize(b.size() + shift);
+        fv_axpy(&c[shift], -f, b.data(), b.size());
+        if (!t.empty()) {
+            len = n + 1 - len;
+            b = t;
+            last = d;
+            shift = 0;
+        }
+    }
+    c.resize(len + 1);
+    Poly<Mod> coef(len);
+    for (std::size_t i = 0; i < len; ++i) coef[i] = -c[i + 1];
+    return coef;
+}
+
+template <i64 Mod>
+Field<Mod> linear_recurrence_nth(const Poly<Mod>& coef, const Poly<Mod>& init, const u64 n) {
+    return LinearRecurrence<Mod>(coef, init)(n);
+}
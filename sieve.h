@@ -0,0 +1,734 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+/* Bit-packed segmented sieve of Eratosthenes with a mod-30 wheel.
+ * One byte covers 30 integers, bit i standing for 30 * byte + residues[i],
+ * so only numbers coprime to 2, 3 and 5 are stored: 8 bits per 30 integers.
+ * Each segment starts from a copy of a pattern with the multiples of 7 to
+ * 19 already crossed off. Primes that hit a segment many times cross off
+ * one wheel turn per loop, and those above the segment span wait in
+ * buckets for the segment of their next multiple.
+ * Based on Kim Walisch's primesieve,
+ * https://github.com/kimwalisch/primesieve/blob/master/doc/ALGORITHMS.md
+ * */
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+// bytes per segment, 0 picks them from the detected cache sizes
+inline std::size_t sieve_segment_bytes = 0;
+
+// threads a single sieve over a range may use, 1 keeps it serial
+inline unsigned sieve_threads = 1;
+
+class PrimeSieve;
+
+namespace sieve_detail {
+
+constexpr u8 residues[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+// from residues[i] to the next one, the last wrapping around to 31
+constexpr u8 gaps[8] = {6, 4, 2, 4, 2, 4, 6, 2};
+
+// largest prime crossed off by the pre-sieve pattern, and its period in bytes
+constexpr u32 presieve_max = 19;
+constexpr std::size_t presieve_bytes = 7 * 11 * 13 * 17 * 19;
+
+struct wheel_tables {
+    u8 bit[30];       // bit of the residue, 8 if not coprime to 30
+    u8 next[30];      // distance to the next residue coprime to 30
+    u8 mask[8][8];    // [p][q] bit of p * q, by the wheel indices of p and q
+    u8 carry[8][8];   // [p][q] bytes the next multiple moves beyond (p / 30) * gaps[q]
+};
+
+constexpr wheel_tables make_tables() {
+    wheel_tables t{};
+    for (int r = 0; r < 30; ++r) t.bit[r] = 8;
+    for (int i = 0; i < 8; ++i) t.bit[residues[i]] = i;
+    for (int r = 0; r < 30; ++r) {
+        int d = 0;
+        while (t.bit[(r + d) % 30] == 8) ++d;
+        t.next[r] = d;
+    }
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            const int rs = residues[i] * residues[j] % 30;
+            t.mask[i][j] = 1 << t.bit[rs];
+            t.carry[i][j] = (rs + residues[i] * gaps[j]) / 30;
+        }
+    }
+    return t;
+}
+
+constexpr wheel_tables tables = make_tables();
+
+/* The multiples of 7, 11, 13, 17 and 19 over one period, themselves included */
+inline const std::vector<u8>& presieve_pattern() {
+    static const std::vector<u8> pattern = [] {
+        std::vector<u8> v(presieve_bytes, 0xff);
+        for (const u64 p: {7, 11, 13, 17, 19}) {
+            for (u64 n = p; n < 30 * presieve_bytes; n += 2 * p) {
+                if (tables.bit[n % 30] < 8) v[n / 30] &= ~(1 << tables.bit[n % 30]);
+            }
+        }
+        return v;
+    }();
+    return pattern;
+}
+
+inline std::size_t cache_bytes(const int level, const std::size_t fallback) {
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    const long v = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+    if (v > 0) return v;
+#endif
+    (void)level;
+    return fallback;
+}
+
+/* Segment size for sieving up to hi
+ * The L1 data cache while every sieving prime crosses off several bits of
+ * each segment, half of L2 once they get sparser, so that fewer of them
+ * have to be visited per crossed off bit.
+ */
+inline std::size_t segment_bytes(const u64 hi) {
+    std::size_t s = sieve_segment_bytes;
+    if (!s) {
+        static const std::size_t l1 = cache_bytes(1, 32 << 10), l2 = cache_bytes(2, 256 << 10);
+        s = std::sqrt(static_cast<double>(hi)) <= 4.0 * l1 ? l1 : std::max(l1, l2 / 2);
+    }
+    return std::max<std::size_t>(s & ~std::size_t(7), 8);
+}
+
+inline u64 isqrt(const u64 n) {
+    u64 r = std::sqrt(static_cast<double>(n));
+    while (r && static_cast<unsigned __int128>(r) * r > n) --r;
+    while (static_cast<unsigned __int128>(r + 1) * (r + 1) <= n) ++r;
+    return r;
+}
+
+/* All primes in [7, lim], lim < 2^32 */
+inline std::vector<u32> sieving_primes(const u64 lim);
+
+/* Upper bound for the number of primes up to x,
+ * Rosser & Schoenfeld below 355991 and Dusart above
+ */
+inline u64 prime_count_bound(const u64 x) {
+    if (x < 17) return 6;
+    const double lx = std::log(static_cast<double>(x));
+    if (x < 355991) return static_cast<u64>(1.25506 * x / lx) + 1;
+    return static_cast<u64>(x / lx * (1 + 1 / lx + 2.51 / (lx * lx))) + 1;
+}
+
+/* Upper bound for the number of primes in [lo, hi]: x / log x <= pi(x)
+ * from 17 on, and at most 2y / log y primes in y consecutive integers
+ * (Montgomery & Vaughan), which is the tighter one for short intervals.
+ */
+inline u64 prime_count_bound(const u64 lo, const u64 hi) {
+    const u64 below = lo > 18 ? static_cast<u64>((lo - 1) / std::log(static_cast<double>(lo - 1))) : 0;
+    const u64 b = prime_count_bound(hi) - below;
+    const double y = static_cast<double>(hi - lo) + 1;
+    return y < 2 ? std::min<u64>(b, 1) : std::min<u64>(b, static_cast<u64>(2 * y / std::log(y)) + 1);
+}
+
+// a sieving prime as it moves from one multiple to the next
+struct crossing {
+    u32 a;      // p / 30
+    u8 p;       // wheel index of p
+    u8 q;       // wheel index of the cofactor of the next multiple
+    u64 pos;    // byte of the next multiple
+};
+
+/* f(n) for every set bit, false if f asked to stop */
+template <typename F>
+bool for_each_bit(const u8* data, const std::size_t size, const u64 base, F&& f) {
+    for (std::size_t i = 0; i < size; i += 8) {
+        u64 w;
+        std::memcpy(&w, data + i, 8);
+        while (w) {
+            const unsigned b = __builtin_ctzll(w);
+            w &= w - 1;
+            const u64 n = 30 * (base + i + b / 8) + residues[b % 8];
+            if constexpr (std::is_same_v<decltype(f(n)), bool>) {
+                if (!f(n)) return false;
+            }
+            else {
+                f(n);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace sieve_detail
+
+/* Sieves [lo, hi] one segment at a time
+ * A segment is a run of size() bytes starting with byte low() / 30, a
+ * multiple of 8. Bits for numbers outside [lo, hi] and for 1 are clear,
+ * the rest are set exactly for the primes; 2, 3 and 5 have no bits and are
+ * left to the caller. The sieving primes, all primes from 7 to isqrt(hi),
+ * can be passed in to share them between sieves.
+ */
+class PrimeSieve {
+private:
+    using crossing = sieve_detail::crossing;
+
+    u64 lo, hi;
+    u64 first = 0, last = 0;   // bytes of lo and hi, first rounded down to a multiple of 8
+    u64 begin = 0;             // first byte of the next segment
+    std::size_t bytes = 0;
+    std::vector<u8> seg;
+    std::size_t seg_size = 0;
+    u64 seg_begin = 0;
+
+    std::vector<u32> own;
+    const std::vector<u32>* primes;
+    std::vector<crossing> medium;
+    std::size_t active = 0;   // medium primes whose square is below the current segment end
+    std::vector<std::vector<crossing>> buckets;
+    std::vector<crossing> spare;
+
+    /* The first multiple p * q >= max(p^2, 30 * first) with q coprime to 30 */
+    crossing start(const u32 p) const {
+        const auto& t = sieve_detail::tables;
+        const u64 from = 30 * first;
+        u64 q = std::max<u64>(p, from / p + (from % p != 0));
+        q += t.next[q % 30];
+        const auto m = static_cast<unsigned __int128>(p) * q;
+        return {p / 30, t.bit[p % 30], t.bit[q % 30], static_cast<u64>(m / 30)};
+    }
+
+    static void step(crossing& c) {
+        const auto& t = sieve_detail::tables;
+        c.pos += static_cast<u64>(c.a) * sieve_detail::gaps[c.q] + t.carry[c.p][c.q];
+        c.q = (c.q + 1) & 7;
+    }
+
+    void push_bucket(const crossing& c) {
+        if (c.pos > last) return;
+        buckets[(c.pos - first) / bytes % buckets.size()].push_back(c);
+    }
+
+    /* Crosses off the multiples of one prime in [seg_begin, end) */
+    void cross_medium(crossing& c, const u64 end) {
+        const auto& t = sieve_detail::tables;
+        u8* s = seg.data();
+        const u8* mask = t.mask[c.p];
+        while (c.q && c.pos < end) {
+            s[c.pos - seg_begin] &= ~mask[c.q];
+            step(c);
+        }
+        const u64 p = 30 * static_cast<u64>(c.a) + sieve_detail::residues[c.p];
+        if (!c.q && c.pos + p <= end) {
+            // a whole wheel turn advances exactly p bytes
+            u64 off[8];
+            crossing d = c;
+            for (int k = 0; k < 8; ++k) {
+                off[k] = d.pos - c.pos;
+                step(d);
+            }
+            u8* x = s + (c.pos - seg_begin);
+            u8* const stop = s + (end - seg_begin) - p;
+            for (; x <= stop; x += p) {
+                for (int k = 0; k < 8; ++k) x[off[k]] &= ~mask[k];
+            }
+            c.pos = seg_begin + (x - s);
+        }
+        while (c.pos < end) {
+            s[c.pos - seg_begin] &= ~mask[c.q];
+            step(c);
+        }
+    }
+
+    void init() {
+        if (lo > hi) return;
+        first = lo / 30 & ~u64(7);
+        last = hi / 30;
+        begin = first;
+        bytes = std::min<u64>(sieve_detail::segment_bytes(hi), (last - first + 8) & ~u64(7));
+        seg.resize(bytes);
+
+        const u64 sq = sieve_detail::isqrt(hi);
+        const auto& ps = *primes;
+        // medium primes hit a segment more than once in a while, the rest at most once
+        const u64 large = 15 * static_cast<u64>(bytes);
+        u64 reach = 0;
+        for (const u32 p: ps) {
+            if (p > sq) break;
+            if (p <= sieve_detail::presieve_max) continue;
+            if (p < large) medium.push_back(start(p));
+            else reach = p;
+        }
+        if (!reach) return;
+        // a step is at most 6 * (p / 30) + 6 bytes, which sets how many
+        // segments ahead a bucket can be; push_bucket drops multiples past
+        // last, so a short range needs no more buckets than it has segments
+        buckets.resize(std::min((6 * (reach / 30) + 6) / bytes + 2, (last - first) / bytes + 2));
+        for (const u32 p: ps) {
+            if (p > sq) break;
+            if (p >= large) push_bucket(start(p));
+        }
+    }
+
+public:
+    PrimeSieve(const u64 lo, const u64 hi) : lo(lo), hi(hi) {
+        own = sieve_detail::sieving_primes(sieve_detail::isqrt(hi));
+        primes = &own;
+        init();
+    }
+
+    PrimeSieve(const u64 lo, const u64 hi, const std::vector<u32>& sieving) : lo(lo), hi(hi), primes(&sieving) {
+        init();
+    }
+
+    PrimeSieve(const PrimeSieve&) = delete;
+    PrimeSieve& operator=(const PrimeSieve&) = delete;
+
+    /* Sieves the next segment, false once past hi */
+    bool next() {
+        if (lo > hi || begin > last) return false;
+        const auto& pattern = sieve_detail::presieve_pattern();
+        seg_begin = begin;
+        seg_size = std::min<u64>(bytes, (last - begin + 8) & ~u64(7));
+        const u64 end = seg_begin + seg_size;
+        begin = end;
+
+        for (std::size_t i = 0, off = seg_begin % sieve_detail::presieve_bytes; i < seg_size;) {
+            const std::size_t n = std::min(seg_size - i, sieve_detail::presieve_bytes - off);
+            std::memcpy(&seg[i], &pattern[off], n);
+            i += n;
+            off = 0;
+        }
+        if (!seg_begin) seg[0] = (seg[0] & ~1) | 0x3e;  // 1 is not a prime, 7 to 19 are
+
+        while (active < medium.size()) {
+            const u64 p = 30 * static_cast<u64>(medium[active].a) + sieve_detail::residues[medium[active].p];
+            if (p * p / 30 >= end) break;
+            ++active;
+        }
+        for (std::size_t i = 0; i < active; ++i) cross_medium(medium[i], end);
+
+        if (!buckets.empty()) {
+            const auto& t = sieve_detail::tables;
+            spare.swap(buckets[(seg_begin - first) / bytes % buckets.size()]);
+            for (crossing c: spare) {
+                // first multiples can lie more than a ring of buckets ahead
+                if (c.pos < end) {
+                    seg[c.pos - seg_begin] &= ~t.mask[c.p][c.q];
+                    step(c);
+                }
+                push_bucket(c);
+            }
+            spare.clear();
+        }
+
+        // clear what lies outside [lo, hi]
+        for (u64 b = std::max(seg_begin, first); b < end && b <= lo / 30; ++b) {
+            if (b < lo / 30) {
+                seg[b - seg_begin] = 0;
+                continue;
+            }
+            for (int i = 0; i < 8; ++i) {
+                if (30 * b + sieve_detail::residues[i] < lo) seg[b - seg_begin] &= ~(1 << i);
+            }
+        }
+        if (end > last) {
+            std::fill(seg.begin() + (last + 1 - seg_begin), seg.begin() + seg_size, 0);
+            const u64 rem = hi - 30 * last;
+            for (int i = 0; i < 8; ++i) {
+                if (sieve_detail::residues[i] > rem) seg[last - seg_begin] &= ~(1 << i);
+            }
+        }
+        return true;
+    }
+
+    u64 low() const noexcept { return 30 * seg_begin; }
+    const u8* data() const noexcept { return seg.data(); }
+    std::size_t size() const noexcept { return seg_size; }
+
+    /* f(p) for the primes in the current segment, in order.
+     * f may return bool, false stops early, which for_each passes on.
+     */
+    template <typename F>
+    bool for_each(F&& f) const {
+        return sieve_detail::for_each_bit(seg.data(), seg_size, seg_begin, f);
+    }
+
+    /* Number of primes in the current segment */
+    u64 count() const noexcept {
+        u64 c = 0;
+        for (std::size_t i = 0; i < seg_size; i += 8) {
+            u64 w;
+            std::memcpy(&w, &seg[i], 8);
+            c += __builtin_popcountll(w);
+        }
+        return c;
+    }
+};
+
+namespace sieve_detail {
+
+inline std::vector<u32> sieving_primes(const u64 lim) {
+    std::vector<u32> ps;
+    if (lim < 7) return ps;
+    if (lim < (u64(1) << 22)) {
+        // odd numbers only, is[i] for 2i + 1
+        std::vector<u8> is(lim / 2 + 1, 1);
+        for (u64 i = 3; i * i <= lim; i += 2) {
+            if (!is[i / 2]) continue;
+            for (u64 j = i * i; j <= lim; j += 2 * i) is[j / 2] = 0;
+        }
+        for (u64 i = 7; i <= lim; i += 2) {
+            if (is[i / 2]) ps.push_back(i);
+        }
+        return ps;
+    }
+    ps.reserve(prime_count_bound(lim));
+    PrimeSieve s(0, lim);
+    while (s.next()) s.for_each([&](const u64 p) { ps.push_back(p); });
+    return ps;
+}
+
+} // namespace sieve_detail
+
+namespace sieve_detail {
+
+/* [lo, hi] cut into pieces for sieve_threads threads: several per thread
+ * to even out the load, but each long enough that finding the first
+ * multiples of the sieving primes stays a small part of the work. Inner
+ * boundaries fall on multiples of 240, the integers of one 64-bit word.
+ */
+inline std::vector<std::pair<u64, u64>> chunks(const u64 lo, const u64 hi, const unsigned threads) {
+    const u64 len = hi - lo;
+    u64 size = std::max<u64>({len / (8 * static_cast<u64>(threads)) + 1, 32 * isqrt(hi), 120 * static_cast<u64>(segment_bytes(hi))});
+    size = (size + 239) / 240 * 240;
+    std::vector<std::pair<u64, u64>> parts;
+    for (u64 a = lo, end = lo / 240 * 240;;) {
+        const u64 b = hi - end < size ? hi : end + size - 1;
+        parts.emplace_back(a, b);
+        if (b == hi) break;
+        a = end = b + 1;
+    }
+    return parts;
+}
+
+/* f(i) for i in [0, n), spread over up to `threads` threads */
+template <typename F>
+void parallel_for(const std::size_t n, const unsigned threads, F f) {
+    std::atomic<std::size_t> next{0};
+    const auto work = [&] {
+        for (std::size_t i; (i = next.fetch_add(1)) < n;) f(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<std::size_t>(threads, n); ++t) pool.emplace_back(work);
+    work();
+    for (auto& th: pool) th.join();
+}
+
+} // namespace sieve_detail
+
+/* The primes in [lo, hi], in increasing order
+ * With sieve_threads > 1 the range is split into chunks. Threads count the
+ * primes of each chunk first. A prefix sum over those counts gives every
+ * chunk its place in the exactly sized output, and a second pass writes
+ * the primes there without locks. The result is the same as the serial one.
+ */
+template <typename T>
+std::vector<T> primes_in_range(const u64 lo, const u64 hi) {
+    std::vector<T> primes;
+    if (lo > hi || hi < 2) return primes;
+    std::size_t small = 0;
+    for (const u64 p: {2, 3, 5}) small += lo <= p && p <= hi;
+
+    const unsigned threads = std::max(1u, sieve_threads);
+    const auto parts = sieve_detail::chunks(lo, hi, threads);
+    if (threads == 1 || parts.size() == 1) {
+        primes.reserve(sieve_detail::prime_count_bound(lo, hi));
+        for (const u64 p: {2, 3, 5}) {
+            if (lo <= p && p <= hi) primes.push_back(T(p));
+        }
+        PrimeSieve sieve(lo, hi);
+        while (sieve.next()) sieve.for_each([&](const u64 p) { primes.push_back(T(p)); });
+        return primes;
+    }
+
+    const std::vector<u32> sieving = sieve_detail::sieving_primes(sieve_detail::isqrt(hi));
+    std::vector<u64> offset(parts.size() + 1);
+    sieve_detail::parallel_for(parts.size(), threads, [&](const std::size_t i) {
+        PrimeSieve sieve(parts[i].first, parts[i].second, sieving);
+        u64 c = 0;
+        while (sieve.next()) c += sieve.count();
+        offset[i + 1] = c;
+    });
+    offset[0] = small;
+    for (std::size_t i = 1; i < offset.size(); ++i) offset[i] += offset[i - 1];
+
+    primes.resize(offset.back());
+    std::size_t k = 0;
+    for (const u64 p: {2, 3, 5}) {
+        if (lo <= p && p <= hi) primes[k++] = T(p);
+    }
+    sieve_detail::parallel_for(parts.size(), threads, [&](const std::size_t i) {
+        T* out = primes.data() + offset[i];
+        PrimeSieve sieve(parts[i].first, parts[i].second, sieving);
+        while (sieve.next()) sieve.for_each([&](const u64 p) { *out++ = T(p); });
+    });
+    return primes;
+}
+
+/* f(p) for every prime p in [lo, hi], in increasing order
+ * f may return bool, false stops the walk and makes for_each_prime return
+ * false. Only one segment and the sieving primes up to isqrt(hi) are held
+ * at a time, so memory stays O(sqrt(hi)) however wide the range.
+ */
+template <typename F>
+bool for_each_prime(const u64 lo, const u64 hi, F&& f) {
+    if (lo > hi) return true;
+    for (const u64 p: {2, 3, 5}) {
+        if (p < lo || p > hi) continue;
+        if constexpr (std::is_same_v<decltype(f(p)), bool>) {
+            if (!f(p)) return false;
+        }
+        else {
+            f(p);
+        }
+    }
+    if (hi < 7) return true;
+    PrimeSieve sieve(lo, hi);
+    while (sieve.next()) {
+        if (!sieve.for_each(f)) return false;
+    }
+    return true;
+}
+
+/* Walks the primes in either direction from any starting point
+ * next() and prev() move a cursor that sits between primes, like *it++
+ * and *--it: after seek(n), next() gives the smallest prime >= n and prev()
+ * the largest one below n, and next() followed by prev() returns the same
+ * prime twice. Both return 0 once they run off either end of the 64-bit
+ * range. The primes are sieved one window at a time, keeping the sieving
+ * primes up to the square root of the window end, which grow as needed.
+ */
+class prime_iterator {
+private:
+    std::vector<u32> sieving;
+    u64 sieving_lim = 0;   // sieving holds the primes from 7 to sieving_lim
+    std::vector<u64> buf;  // the primes in [wlo, whi]
+    u64 wlo = 0, whi = 0;
+    std::size_t pos = 0;
+
+    // windows long enough to amortise finding the first multiples, but
+    // bounded so the buffer stays small
+    static u64 span(const u64 n) {
+        const u64 s = 30 * static_cast<u64>(sieve_detail::segment_bytes(n));
+        return std::min<u64>(std::max<u64>(s, 4 * sieve_detail::isqrt(n)), u64(1) << 28);
+    }
+
+    void fill(const u64 lo, const u64 hi) {
+        wlo = lo;
+        whi = hi;
+        buf.clear();
+        const u64 sq = sieve_detail::isqrt(hi);
+        if (sq > sieving_lim) {
+            sieving_lim = std::min<u64>(std::max(sq, 2 * sieving_lim), 0xffffffff);
+            sieving = sieve_detail::sieving_primes(sieving_lim);
+        }
+        for (const u64 p: {2, 3, 5}) {
+            if (lo <= p && p <= hi) buf.push_back(p);
+        }
+        if (hi < 7) return;
+        PrimeSieve sieve(lo, hi, sieving);
+        while (sieve.next()) sieve.for_each([&](const u64 p) { buf.push_back(p); });
+    }
+
+    bool fill_after() {
+        if (whi == ~u64(0)) return false;
+        const u64 lo = whi + 1, s = span(lo);
+        fill(lo, ~u64(0) - lo < s ? ~u64(0) : lo + s - 1);
+        return true;
+    }
+
+    bool fill_before() {
+        if (!wlo) return false;
+        const u64 hi = wlo - 1, s = span(hi);
+        fill(hi < s ? 0 : hi - s + 1, hi);
+        return true;
+    }
+
+public:
+    explicit prime_iterator(const u64 start = 0) { seek(start); }
+
+    void seek(const u64 n) {
+        const u64 s = span(n);
+        fill(n, ~u64(0) - n < s ? ~u64(0) : n + s - 1);
+        pos = 0;
+    }
+
+    u64 next() {
+        while (pos == buf.size()) {
+            if (!fill_after()) return 0;
+            pos = 0;
+        }
+        return buf[pos++];
+    }
+
+    u64 prev() {
+        while (!pos) {
+            if (!fill_before()) return 0;
+            pos = buf.size();
+        }
+        return buf[--pos];
+    }
+};
+
+/* Numbers of primes and of prime k-tuplets in an interval
+ * tuplets[k] for k = 2 to 6 counts twins, triplets, quadruplets,
+ * quintuplets and sextuplets: the admissible constellations (p, p + 2),
+ * (p, p + 2, p + 6), (p, p + 4, p + 6), (p, p + 2, p + 6, p + 8),
+ * (p, p + 2, p + 6, p + 8, p + 12), (p, p + 4, p + 6, p + 10, p + 12) and
+ * (p, p + 4, p + 6, p + 10, p + 12, p + 16).
+ */
+struct PrimeCounts {
+    u64 primes = 0;
+    u64 tuplets[7] = {};
+
+    PrimeCounts& operator+=(const PrimeCounts& rhs) noexcept {
+        primes += rhs.primes;
+        for (int k = 2; k <= 6; ++k) tuplets[k] += rhs.tuplets[k];
+        return *this;
+    }
+};
+
+namespace sieve_detail {
+
+/* One prime constellation with its smallest member at one residue mod 30.
+ * The bits of the members lie at fixed distances from that of the first,
+ * so a word of starts ANDed with the word shifted by each distance leaves
+ * the bits of the tuplets starting there.
+ */
+struct constellation {
+    int k;
+    u64 starts;        // bits of the residue in every byte
+    int n;
+    u8 shift[5];       // bit distances to the other members
+};
+
+inline const std::vector<constellation>& constellations() {
+    static const std::vector<constellation> list = [] {
+        // the admissible patterns of 2 to 6 primes, as in primesieve
+        const std::vector<std::vector<int>> patterns = {
+            {0, 2}, {0, 2, 6}, {0, 4, 6}, {0, 2, 6, 8},
+            {0, 2, 6, 8, 12}, {0, 4, 6, 10, 12}, {0, 4, 6, 10, 12, 16}};
+        std::vector<constellation> v;
+        for (const auto& d: patterns) {
+            for (int i = 0; i < 8; ++i) {
+                constellation c{static_cast<int>(d.size()), 0x0101010101010101ull << i, 0, {}};
+                bool ok = true;
+                for (std::size_t j = 1; j < d.size(); ++j) {
+                    const int m = residues[i] + d[j];
+                    ok &= tables.bit[m % 30] < 8;
+                    if (ok) c.shift[c.n++] = 8 * (m / 30) + tables.bit[m % 30] - i;
+                }
+                if (ok) v.push_back(c);
+            }
+        }
+        return v;
+    }();
+    return list;
+}
+
+/* Primes in word x and the tuplets starting there, next holding the
+ * following 64 bits
+ */
+inline void count_word(PrimeCounts& c, const u64 x, const u64 next, const bool tuplets) {
+    c.primes += __builtin_popcountll(x);
+    if (!tuplets || !x) return;
+    u64 sh[16];
+    for (int s = 1; s < 16; ++s) sh[s] = x >> s | next << (64 - s);
+    for (const constellation& k: constellations()) {
+        u64 t = x & k.starts;
+        for (int j = 0; j < k.n && t; ++j) t &= sh[k.shift[j]];
+        c.tuplets[k.k] += __builtin_popcountll(t);
+    }
+}
+
+/* Counts over [a, b] for primes from 7 on, tuplets by their smallest
+ * member, whose others may reach up to hi. b + 1 is a multiple of 240 or
+ * b = hi, so with tuplets the sieve runs one word past b for the rest of
+ * the tuplets starting in the last word.
+ */
+inline PrimeCounts count_chunk(const u64 a, const u64 b, const u64 hi, const bool tuplets,
+                               const std::vector<u32>& sieving) {
+    PrimeCounts c;
+    if (b < 7) return c;
+    const u64 last = b / 240;
+    const u64 end = tuplets && hi - b >= 240 ? b + 240 : tuplets ? hi : b;
+    PrimeSieve sieve(a, end, sieving);
+    u64 prev = 0, word = 0;
+    bool have = false;
+    while (sieve.next()) {
+        const u8* d = sieve.data();
+        const u64 base = sieve.low() / 240;
+        for (std::size_t i = 0; i < sieve.size(); i += 8) {
+            u64 w;
+            std::memcpy(&w, d + i, 8);
+            if (have && word <= last) count_word(c, prev, w, tuplets);
+            prev = w;
+            word = base + i / 8;
+            have = true;
+        }
+    }
+    if (have && word <= last) count_word(c, prev, 0, tuplets);
+    return c;
+}
+
+inline PrimeCounts count_range(const u64 lo, const u64 hi, const bool tuplets) {
+    PrimeCounts c;
+    if (lo > hi) return c;
+    for (const u64 p: {2, 3, 5}) c.primes += lo <= p && p <= hi;
+    if (tuplets) {
+        // the constellations through 3 or 5, which have no bits
+        static const std::vector<std::vector<u64>> small = {
+            {3, 5}, {5, 7}, {5, 7, 11}, {5, 7, 11, 13}, {5, 7, 11, 13, 17}};
+        for (const auto& t: small) c.tuplets[t.size()] += lo <= t.front() && t.back() <= hi;
+    }
+    if (hi < 7) return c;
+
+    const unsigned threads = std::max(1u, sieve_threads);
+    const auto parts = chunks(lo, hi, threads);
+    const std::vector<u32> sieving = sieving_primes(isqrt(hi));
+    std::vector<PrimeCounts> part(parts.size());
+    parallel_for(parts.size(), threads, [&](const std::size_t i) {
+        part[i] = count_chunk(parts[i].first, parts[i].second, hi, tuplets, sieving);
+    });
+    for (const auto& p: part) c += p;
+    return c;
+}
+
+} // namespace sieve_detail
+
+/* Number of primes in [lo, hi]
+ * Sums popcounts over the sieve without writing out any prime, on
+ * sieve_threads threads.
+ */
+inline u64 count_primes(const u64 lo, const u64 hi) {
+    return sieve_detail::count_range(lo, hi, false).primes;
+}
+
+/* Primes and prime k-tuplets in [lo, hi] in the same pass, a tuplet
+ * counting when all of its members lie in the interval
+ */
+inline PrimeCounts count_prime_tuplets(const u64 lo, const u64 hi) {
+    return sieve_detail::count_range(lo, hi, true);
+}